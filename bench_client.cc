@@ -0,0 +1,175 @@
+/*  bench_client.cc
+ *  Description: Runs a fixed set of positions through perft (with each
+ *               generator), move generation, make/unmake and search, and
+ *               reports the nodes, time and nodes per second of each. The
+ *               signature only depends on the node counts and the hashes
+ *               make/unmake reaches, so it changes when move generation,
+ *               hashing or the search changes, but not with speed.
+*/
+#define _GLIBCXX_USE_CXX11_ABI 0
+#include "board.hpp"
+#include "search.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Standard perft test positions, then some quieter middlegames for the search
+static const char *BENCH_FENS[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+  "r3k2r/p2n1pp1/2pb1p1p/qp1p3P/3P1PP1/2NQP1N1/PPP5/R3K2R w KQkq - 2 15",
+  "rnb1kb1r/2q2ppp/p2ppn2/8/1p1NPP2/P1NB4/1PP1Q1PP/R1B1K2R w KQkq - 0 10",
+};
+#define NUM_BENCH_FENS (int)(sizeof(BENCH_FENS) / sizeof(BENCH_FENS[0]))
+
+#define PERFT_DEPTH 4
+#define MAILBOX_PERFT_DEPTH 3
+#define MOVEGEN_ITERATIONS 200000
+#define MAKE_UNMAKE_ITERATIONS 20000
+#define SEARCH_DEPTH 7
+
+struct BenchResult {
+  std::string name;
+  long nodes;
+  double seconds;
+  uint64_t checksum;  // Also goes into the signature, e.g. the hashes make_unmake saw
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static BenchResult bench_perft(MoveGenerator generator, int depth, const char *name) {
+  BenchResult result = {name, 0, 0, 0};
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < NUM_BENCH_FENS; i++) {
+    Board board(BENCH_FENS[i]);
+    board.setGenerator(generator);
+    result.nodes += board.perft(depth);
+  }
+  result.seconds = seconds_since(start);
+  return result;
+}
+
+// Counts every move generated
+static BenchResult bench_movegen() {
+  BenchResult result = {"movegen", 0, 0, 0};
+  Clock::time_point start = Clock::now();
+  MoveList moves;
+  for (int i = 0; i < NUM_BENCH_FENS; i++) {
+    Board board(BENCH_FENS[i]);
+    for (int n = 0; n < MOVEGEN_ITERATIONS; n++) {
+      board.generateMoves(moves);
+      result.nodes += moves.size();
+    }
+  }
+  result.seconds = seconds_since(start);
+  return result;
+}
+
+// Counts every move played and taken back
+static BenchResult bench_make_unmake() {
+  BenchResult result = {"make_unmake", 0, 0, 0};
+  MoveList moves;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < NUM_BENCH_FENS; i++) {
+    Board board(BENCH_FENS[i]);
+    board.generateMoves(moves);
+    for (int n = 0; n < MAKE_UNMAKE_ITERATIONS; n++) {
+      for (uint32_t m = 0; m < moves.size(); m++) {
+        Undo undo;
+        board.doMove(moves[m], undo);
+        result.checksum += board.hash();  // Summed, since an even number of XORs would cancel
+        board.undoMove(moves[m], undo);
+      }
+      result.nodes += moves.size();
+    }
+  }
+  result.seconds = seconds_since(start);
+  return result;
+}
+
+static BenchResult bench_search(int depth) {
+  BenchResult result = {"search", 0, 0, 0};
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < NUM_BENCH_FENS; i++) {
+    Board board(BENCH_FENS[i]);
+    // A fresh table each time keeps the node counts independent of the order
+    TranspositionTable tt(16);
+    Search search(tt);
+    SearchLimits limits;
+    limits.depth = depth;
+    result.nodes += search.run(board, limits).nodes;
+  }
+  result.seconds = seconds_since(start);
+  return result;
+}
+
+static long nps(long nodes, double seconds) {
+  return seconds > 0 ? (long)(nodes / seconds) : 0;
+}
+
+int main(int argc, char **argv) {
+  // --json prints the results as JSON instead of a table
+  // --depth <D> changes the search depth
+  bool json = false;
+  int search_depth = SEARCH_DEPTH;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--json") {
+      json = true;
+    } else if (arg == "--depth" && i + 1 < argc) {
+      search_depth = std::atoi(argv[++i]);
+    }
+  }
+
+  std::vector<BenchResult> results;
+  results.push_back(bench_perft(BITBOARD_GENERATOR, PERFT_DEPTH, "perft_bitboard"));
+  results.push_back(bench_perft(MAILBOX_GENERATOR, MAILBOX_PERFT_DEPTH, "perft_mailbox"));
+  results.push_back(bench_movegen());
+  results.push_back(bench_make_unmake());
+  results.push_back(bench_search(search_depth));
+
+  long total_nodes = 0;
+  double total_seconds = 0;
+  uint64_t signature = 0;
+  for (uint32_t i = 0; i < results.size(); i++) {
+    total_nodes += results[i].nodes;
+    total_seconds += results[i].seconds;
+    // FNV-1a over the node counts and checksums
+    signature = (signature ^ (uint64_t)results[i].nodes) * 0x100000001B3ULL;
+    signature = (signature ^ results[i].checksum) * 0x100000001B3ULL;
+  }
+
+  if (json) {
+    std::cout << "{\n  \"positions\": " << NUM_BENCH_FENS << ",\n  \"search_depth\": " << search_depth
+              << ",\n  \"tests\": [\n";
+    for (uint32_t i = 0; i < results.size(); i++) {
+      std::cout << "    {\"name\": \"" << results[i].name << "\", \"nodes\": " << results[i].nodes
+                << ", \"time_ms\": " << (long)(results[i].seconds * 1000)
+                << ", \"nps\": " << nps(results[i].nodes, results[i].seconds) << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    std::cout << "  ],\n  \"nodes\": " << total_nodes << ",\n  \"time_ms\": " << (long)(total_seconds * 1000)
+              << ",\n  \"nps\": " << nps(total_nodes, total_seconds) << ",\n  \"signature\": \""
+              << std::hex << signature << std::dec << "\"\n}" << std::endl;
+  } else {
+    for (uint32_t i = 0; i < results.size(); i++) {
+      std::cout << results[i].name << ": " << results[i].nodes << " nodes, "
+                << (long)(results[i].seconds * 1000) << " ms, "
+                << nps(results[i].nodes, results[i].seconds) << " nps" << std::endl;
+    }
+    std::cout << "Total: " << total_nodes << " nodes, " << (long)(total_seconds * 1000) << " ms, "
+              << nps(total_nodes, total_seconds) << " nps" << std::endl;
+    std::cout << "Signature: " << std::hex << signature << std::dec << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// bitboard.cc
+// Builds the attack tables used by the bitboard move generator
+
+#include "bitboard.hpp"
+
+Magic BISHOP_MAGICS[NUM_SQUARES];
+Magic ROOK_MAGICS[NUM_SQUARES];
+
+// Every square's attack sets are stored one after the other in these tables
+static Bitboard BISHOP_TABLE[0x1480];
+static Bitboard ROOK_TABLE[0x19000];
+
+// Steps as {file, rank} offsets
+static constexpr int KNIGHT_STEPS[8][2] = {{1, 2}, {-1, 2}, {2, 1}, {2, -1},
+                                           {1, -2}, {-1, -2}, {-2, 1}, {-2, -1}};
+static constexpr int KING_STEPS[8][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0},
+                                         {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+static constexpr int BISHOP_STEPS[4][2] = {{1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+static constexpr int ROOK_STEPS[4][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+
+// Small xorshift generator for finding magics. It is seeded with fixed
+//  values so the tables come out the same on every run
+class MagicRNG {
+  public:
+    MagicRNG(uint64_t seed) : _s(seed) {}
+    uint64_t rand64() {
+      _s ^= _s >> 12;
+      _s ^= _s << 25;
+      _s ^= _s >> 27;
+      return _s * 2685821657736338717ULL;
+    }
+    // Magics with few set bits are found much faster
+    uint64_t sparse_rand() {
+      return rand64() & rand64() & rand64();
+    }
+  private:
+    uint64_t _s;
+};
+
+// Seeds (one per rank) which find magics quickly
+static const uint64_t MAGIC_SEEDS[8] = {728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+
+// Squares reached from sq by taking each step once, staying on the board
+static constexpr Bitboard step_attacks(int sq, const int steps[][2], int num_steps) {
+  Bitboard attacks = EMPTY_BB;
+  for (int i = 0; i < num_steps; i++) {
+    int file = sq % 8 + steps[i][0];
+    int rank = sq / 8 + steps[i][1];
+    if (file >= 0 && file < 8 && rank >= 0 && rank < 8) {
+      attacks |= SQ_BB(rank * 8 + file);
+    }
+  }
+  return attacks;
+}
+
+// Squares reached by sliding from sq along each direction, up to and
+//  including the first occupied square. Slow, only used to fill the tables
+static constexpr Bitboard sliding_attacks(int sq, Bitboard occupied, const int steps[4][2]) {
+  Bitboard attacks = EMPTY_BB;
+  for (int i = 0; i < 4; i++) {
+    int file = sq % 8 + steps[i][0];
+    int rank = sq / 8 + steps[i][1];
+    while (file >= 0 && file < 8 && rank >= 0 && rank < 8) {
+      Bitboard b = SQ_BB(rank * 8 + file);
+      attacks |= b;
+      if (occupied & b) {
+        break;
+      }
+      file += steps[i][0];
+      rank += steps[i][1];
+    }
+  }
+  return attacks;
+}
+
+static constexpr SquareTable step_table(const int steps[8][2]) {
+  SquareTable table = {};
+  for (int sq = 0; sq < NUM_SQUARES; sq++) {
+    table[sq] = step_attacks(sq, steps, 8);
+  }
+  return table;
+}
+
+static constexpr std::array<SquareTable, 2> pawn_table() {
+  std::array<SquareTable, 2> table = {};
+  for (int sq = 0; sq < NUM_SQUARES; sq++) {
+    Bitboard b = SQ_BB(sq);
+    table[0][sq] = ((b & ~FILE_A_BB) << 7) | ((b & ~FILE_H_BB) << 9);
+    table[1][sq] = ((b & ~FILE_A_BB) >> 9) | ((b & ~FILE_H_BB) >> 7);
+  }
+  return table;
+}
+
+// BETWEEN when between is true, otherwise LINE
+static constexpr std::array<SquareTable, NUM_SQUARES> line_table(bool between) {
+  std::array<SquareTable, NUM_SQUARES> table = {};
+  for (int a = 0; a < NUM_SQUARES; a++) {
+    for (int b = 0; b < NUM_SQUARES; b++) {
+      if (a == b) {
+        continue;
+      }
+      const int (*steps)[2] = sliding_attacks(a, EMPTY_BB, BISHOP_STEPS) & SQ_BB(b) ? BISHOP_STEPS
+        : sliding_attacks(a, EMPTY_BB, ROOK_STEPS) & SQ_BB(b) ? ROOK_STEPS : nullptr;
+      if (!steps) {
+        continue;
+      }
+      if (between) {
+        table[a][b] = sliding_attacks(a, SQ_BB(b), steps) & sliding_attacks(b, SQ_BB(a), steps);
+      } else {
+        table[a][b] = (sliding_attacks(a, EMPTY_BB, steps) & sliding_attacks(b, EMPTY_BB, steps))
+          | SQ_BB(a) | SQ_BB(b);
+      }
+    }
+  }
+  return table;
+}
+
+constexpr SquareTable KNIGHT_ATTACKS = step_table(KNIGHT_STEPS);
+constexpr SquareTable KING_ATTACKS = step_table(KING_STEPS);
+constexpr std::array<SquareTable, 2> PAWN_ATTACKS = pawn_table();
+constexpr std::array<SquareTable, NUM_SQUARES> BETWEEN = line_table(true);
+constexpr std::array<SquareTable, NUM_SQUARES> LINE = line_table(false);
+
+// Finds a magic for every square and fills its slice of the attack table
+static void init_magics(Magic magics[], Bitboard table[], const int steps[4][2]) {
+  Bitboard occupancy[4096];
+  Bitboard reference[4096];
+  int epoch[4096] = {0};
+  int attempt = 0;
+  int size = 0;
+
+  for (int sq = 0; sq < NUM_SQUARES; sq++) {
+    Magic &m = magics[sq];
+
+    // Pieces on the edge of the board never block anything further along
+    Bitboard edges = ((RANK_1_BB | RANK_8_BB) & ~(RANK_1_BB << (8 * (sq / 8))))
+                   | ((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << (sq % 8)));
+    m.mask = sliding_attacks(sq, EMPTY_BB, steps) & ~edges;
+    m.shift = 64 - popcount(m.mask);
+    m.attacks = sq == 0 ? table : magics[sq - 1].attacks + size;
+
+    // Enumerate every subset of the mask (Carry-Rippler trick)
+    // along with the attacks it produces
+    size = 0;
+    Bitboard b = EMPTY_BB;
+    do {
+      occupancy[size] = b;
+      reference[size] = sliding_attacks(sq, b, steps);
+#ifdef __BMI2__
+      m.attacks[m.index(b)] = reference[size];
+#endif
+      size++;
+      b = (b - m.mask) & m.mask;
+    } while (b);
+
+#ifndef __BMI2__
+    // Try random magics until one maps every occupancy to an index
+    //  without a destructive collision
+    MagicRNG rng(MAGIC_SEEDS[sq / 8]);
+    int i = 0;
+    while (i < size) {
+      do {
+        m.magic = rng.sparse_rand();
+      } while (popcount((m.magic * m.mask) >> 56) < 6);
+
+      attempt++;
+      for (i = 0; i < size; i++) {
+        unsigned idx = m.index(occupancy[i]);
+        if (epoch[idx] < attempt) {
+          epoch[idx] = attempt;
+          m.attacks[idx] = reference[i];
+        } else if (m.attacks[idx] != reference[i]) {
+          break;
+        }
+      }
+    }
+#endif
+  }
+}
+
+static void fill_tables() {
+  init_magics(BISHOP_MAGICS, BISHOP_TABLE, BISHOP_STEPS);
+  init_magics(ROOK_MAGICS, ROOK_TABLE, ROOK_STEPS);
+}
+
+void init_bitboards() {
+  // Function-local statics are initialized exactly once, even across threads
+  static bool initialized = (fill_tables(), true);
+  (void)initialized;
+}
+
+std::string bb_to_string(Bitboard b) {
+  std::string s;
+  for (int rank = 7; rank >= 0; rank--) {
+    for (int file = 0; file < 8; file++) {
+      s += (b & SQ_BB(rank * 8 + file)) ? "X " : "_ ";
+    }
+    s += "\n";
+  }
+  return s;
+}
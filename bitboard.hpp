@@ -0,0 +1,103 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _BITBOARD_HPP_
+#define _BITBOARD_HPP_
+
+// bitboard.hpp
+// 64-bit sets of squares, along with precomputed attack tables, used by the
+// bitboard move generator. Bit 0 is a1, bit 7 is h1 and bit 63 is h8.
+
+#include <stdint.h>
+#include <array>
+#include <string>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+typedef uint64_t Bitboard;
+
+#define NUM_SQUARES 64
+#define EMPTY_BB 0ULL
+#define RANK_1_BB 0xFFULL
+#define RANK_2_BB (RANK_1_BB << 8)
+#define RANK_3_BB (RANK_1_BB << 16)
+#define RANK_6_BB (RANK_1_BB << 40)
+#define RANK_7_BB (RANK_1_BB << 48)
+#define RANK_8_BB (RANK_1_BB << 56)
+#define FILE_A_BB 0x0101010101010101ULL
+#define FILE_H_BB (FILE_A_BB << 7)
+#define DARK_SQUARES_BB 0xAA55AA55AA55AA55ULL  // a1, c1, ..., b2, ...
+
+#define SQ_BB(sq) (1ULL << (sq))
+
+// These tables are built at compile time. Only the magic tables are filled in by init_bitboards
+typedef std::array<Bitboard, NUM_SQUARES> SquareTable;
+
+extern const SquareTable KNIGHT_ATTACKS;
+extern const SquareTable KING_ATTACKS;
+extern const std::array<SquareTable, 2> PAWN_ATTACKS;  // Indexed by the color of the attacking pawn
+
+// For two squares on a shared rank, file or diagonal: the squares strictly between
+//  them, and the whole line through them. Empty if the squares are not aligned
+extern const std::array<SquareTable, NUM_SQUARES> BETWEEN;
+extern const std::array<SquareTable, NUM_SQUARES> LINE;
+
+// Everything needed to look up the attacks of a slider on one square.
+//  The relevant occupancy is hashed to an index with a magic multiply
+//  (or with PEXT when the CPU has BMI2)
+struct Magic {
+  Bitboard mask;  // Squares whose occupancy can block the slider, excluding edges
+  Bitboard magic;
+  Bitboard *attacks;
+  unsigned shift;
+
+  unsigned index(Bitboard occupied) const;
+};
+
+extern Magic BISHOP_MAGICS[NUM_SQUARES];
+extern Magic ROOK_MAGICS[NUM_SQUARES];
+
+// Finds the magics and fills in the slider attack tables. Safe to call more than once.
+void init_bitboards();
+
+inline unsigned Magic::index(Bitboard occupied) const {
+#ifdef __BMI2__
+  return (unsigned)_pext_u64(occupied, mask);
+#else
+  return (unsigned)(((occupied & mask) * magic) >> shift);
+#endif
+}
+
+inline Bitboard bishop_attacks(int sq, Bitboard occupied) {
+  const Magic &m = BISHOP_MAGICS[sq];
+  return m.attacks[m.index(occupied)];
+}
+
+inline Bitboard rook_attacks(int sq, Bitboard occupied) {
+  const Magic &m = ROOK_MAGICS[sq];
+  return m.attacks[m.index(occupied)];
+}
+
+inline Bitboard queen_attacks(int sq, Bitboard occupied) {
+  return bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
+}
+
+inline int popcount(Bitboard b) {
+  return __builtin_popcountll(b);
+}
+
+// Index of the least significant set bit. b must not be empty
+inline int lsb(Bitboard b) {
+  return __builtin_ctzll(b);
+}
+
+// Removes the least significant set bit from b and returns its index
+inline int pop_lsb(Bitboard &b) {
+  int sq = lsb(b);
+  b &= b - 1;
+  return sq;
+}
+
+// Debug helper which draws a bitboard in the same layout as the Board
+std::string bb_to_string(Bitboard b);
+
+#endif // _BITBOARD_HPP_
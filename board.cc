@@ -3,6 +3,10 @@
 // A straight-forward implementation of a chess game
 
 #include "board.hpp"
+#include "zobrist.hpp"
+#include "eval.hpp"
+#include "perft_table.hpp"
+#include "thread_pool.hpp"
 #include <algorithm>
 #include <iterator>
 #include <string>
@@ -10,10 +14,15 @@
 #include <iostream>
 #include <cstdio>
 #include <cstring>
+#include <charconv>
+#include <cstdlib>
 #include <stdint.h>
 #include <assert.h>
+#include <type_traits>
 
-const char *Board::_VALID_ATTACKS = 0;
+// Boards are copied for every search thread and saved position, so keep them
+//  free of anything that would need a deep copy
+static_assert(std::is_trivially_copyable<Board>::value, "Board must be trivially copyable");
 
 // Helper function which returns the index into _board array
 //  corresponding to the given alpha-numeric board position given
@@ -75,6 +84,9 @@ int symbol_to_piece(char sym) {
   return piece_num;
 }
 
+// FEN letter of each piece, indexed by the piece plus KING
+static const char PIECE_SYMBOLS[] = "kqrbnp_PNBRQK";
+
 // Helper function which given the integer definition of a piece (E.g. PAWN == 1)
 // returns the string representation. Used for drawing the board.
 std::string get_symbol(int piece_num) {
@@ -139,365 +151,896 @@ std::string sq_name(int sq) {
   return file_ch + std::to_string(rank);
 }
 
-// Copy-Constructor
-Board::Board(const Board& other) {
-  // TODO: This function could just ask for the FEN of the other function, and
-  //       initialize the board from that... So why not?
-  _board = new int[BOARD_ARR_LEN];
-  std::copy(other._board, other._board+BOARD_ARR_LEN, _board);
-  _half_moves = other._half_moves;
-  _full_moves = other._full_moves;
-  _color_to_play = other._color_to_play;
-  _en_passant_square = other._en_passant_square;
-  _castling_rights = new bool*[2]();
-  _castling_rights[WHITE] = new bool[2]();
-  _castling_rights[BLACK] = new bool[2]();
-  _castling_rights[WHITE][QUEEN_SIDE] = other._castling_rights[WHITE][QUEEN_SIDE];
-  _castling_rights[WHITE][KING_SIDE] = other._castling_rights[WHITE][KING_SIDE];;
-  _castling_rights[BLACK][QUEEN_SIDE] = other._castling_rights[BLACK][QUEEN_SIDE];;
-  _castling_rights[BLACK][KING_SIDE] = other._castling_rights[BLACK][KING_SIDE];;
-  _white_king_sq = other._white_king_sq;
-  _black_king_sq = other._black_king_sq;
+// Construct Board from FEN string
+Board::Board(std::string_view fen) {
+  FenError error = setFen(fen);
+  assert(error == FEN_OK);
+  (void)error;
 }
 
-// Construct Board from FEN string
-Board::Board(std::string fen) {
-  // Split up the fen
-  std::vector<std::string> tokens;
-  std::istringstream iss(fen);
-  std::copy(std::istream_iterator<std::string>(iss),
-      std::istream_iterator<std::string>(),
-      std::back_inserter(tokens));
-  std::string board_str = tokens[0];
-  std::string color_to_play_str = tokens[1];
-  std::string castling_rights_str = tokens[2];
-  std::string en_passant_sq_str = tokens[3];
-  std::string half_moves_str = tokens[4];
-  std::string full_moves_str = tokens[5];
-
-  _board = new int[BOARD_ARR_LEN];
-  for(int i = 0; i < BOARD_ARR_LEN; i++) {
+// Removes and returns the next space separated field of a FEN, or an empty
+//  view once there are none left
+static std::string_view next_fen_field(std::string_view &rest) {
+  size_t start = rest.find_first_not_of(' ');
+  if (start == std::string_view::npos) {
+    rest = std::string_view();
+    return rest;
+  }
+  size_t end = rest.find(' ', start);
+  if (end == std::string_view::npos) {
+    end = rest.size();
+  }
+  std::string_view field = rest.substr(start, end - start);
+  rest.remove_prefix(end);
+  return field;
+}
+
+// Parses a whole field as a non-negative number
+static bool parse_fen_number(std::string_view field, int &value) {
+  const char *end = field.data() + field.size();
+  std::from_chars_result result = std::from_chars(field.data(), end, value);
+  return result.ec == std::errc() && result.ptr == end && value >= 0;
+}
+
+FenError Board::setFen(std::string_view fen) {
+  init_bitboards();
+  init_zobrist();
+  init_eval();
+  for (int i = 0; i < BOARD_ARR_LEN; i++) {
     _board[i] = OUTOFBOUNDS;
   }
+  for (int rank = 0; rank < 8; rank++) {
+    for (int file = 0; file < 8; file++) {
+      _board[A1 + (UP * rank) + (RIGHT * file)] = EMPTY;
+    }
+  }
+  for (int color = WHITE; color <= BLACK; color++) {
+    _occupied[color] = EMPTY_BB;
+    for (int piece = EMPTY; piece <= KING; piece++) {
+      _pieces[color][piece] = EMPTY_BB;
+    }
+  }
+  _generator = BITBOARD_GENERATOR;
+  _hash = 0;
+  _mg_score = 0;
+  _eg_score = 0;
+  _phase = 0;
+
+  // Parse FEN and place pieces accordingly, from a8 across and down to h1
+  std::string_view rest = fen;
+  std::string_view placement = next_fen_field(rest);
+  int rank = 7;
+  int file = 0;
+  for (char fen_ch : placement) {
+    if (fen_ch == '/') {
+      if (file != 8 || rank == 0) {
+        return FEN_BAD_PLACEMENT;
+      }
+      rank--;
+      file = 0;
+    } else if (fen_ch >= '1' && fen_ch <= '8') {
+      file += fen_ch - '0';
+      if (file > 8) {
+        return FEN_BAD_PLACEMENT;
+      }
+    } else {
+      int p = symbol_to_piece(fen_ch);
+      if (p == OUTOFBOUNDS || p == EMPTY || file >= 8) {
+        return FEN_BAD_PLACEMENT;
+      }
+      _put_piece(A1 + (UP * rank) + (RIGHT * file), p);
+      file++;
+    }
+  }
+  if (rank != 0 || file != 8) {
+    return FEN_BAD_PLACEMENT;
+  }
+  if (popcount(_pieces[WHITE][KING]) != 1 || popcount(_pieces[BLACK][KING]) != 1) {
+    return FEN_BAD_KINGS;
+  }
+  // Pawns on the first or last rank would push off the board
+  if ((_pieces[WHITE][PAWN] | _pieces[BLACK][PAWN]) & (RANK_1_BB | RANK_8_BB)) {
+    return FEN_BAD_PLACEMENT;
+  }
+  // More pieces than a game can reach could generate more than MAX_MOVES moves
+  for (int c = WHITE; c <= BLACK; c++) {
+    if (popcount(_occupied[c]) > 16 || popcount(_pieces[c][PAWN]) > 8) {
+      return FEN_BAD_PLACEMENT;
+    }
+  }
+  _white_king_sq = SQ256(lsb(_pieces[WHITE][KING]));
+  _black_king_sq = SQ256(lsb(_pieces[BLACK][KING]));
+
+  std::string_view color = next_fen_field(rest);
+  if (color == "w") {
+    _color_to_play = WHITE;
+  } else if (color == "b") {
+    _color_to_play = BLACK;
+  } else {
+    return FEN_BAD_COLOR;
+  }
+  // Otherwise the side to move could capture the king
+  if (_attacked(_color_to_play == WHITE ? _black_king_sq : _white_king_sq, _color_to_play)) {
+    return FEN_BAD_CHECK;
+  }
 
-  std::istringstream board_ss(board_str);
-  std::string curr_rank;
-  // Parse FEN and place pieces accordingly
-  for (int rank = 7; rank >= 0; rank--) {
-    std::getline(board_ss, curr_rank, '/');
-    int file = 0;
-    for (uint8_t char_i = 0; char_i < curr_rank.size(); char_i++) {
-      char fen_ch = curr_rank[char_i];
-      if ((fen_ch <= '8') && (fen_ch >= '1')) {
-        for(int i = 0; i < fen_ch - '1' + 1; i++) {
-          _board[A1 + (UP * rank) + (RIGHT * i) + file] = EMPTY;
-        }
-        file += (fen_ch - '1' + 1);
-      } else {
-        int p = symbol_to_piece(fen_ch);
-        int sq = A1 + (UP * rank) + (RIGHT * file);
-        _board[sq] = p;
-        if (p == KING) {
-          _white_king_sq = sq; 
-        }
-        if (p == -KING) {
-          _black_king_sq = sq; 
-        }
-        file++;
+  std::string_view castling = next_fen_field(rest);
+  _castling_rights = NO_CASTLING;
+  if (castling.empty()) {
+    return FEN_BAD_CASTLING;
+  }
+  if (castling != "-") {
+    for (char ch : castling) {
+      switch (ch) {
+        case 'K': _castling_rights |= CASTLING_BIT(WHITE, KING_SIDE); break;
+        case 'Q': _castling_rights |= CASTLING_BIT(WHITE, QUEEN_SIDE); break;
+        case 'k': _castling_rights |= CASTLING_BIT(BLACK, KING_SIDE); break;
+        case 'q': _castling_rights |= CASTLING_BIT(BLACK, QUEEN_SIDE); break;
+        default: return FEN_BAD_CASTLING;
       }
     }
   }
+  // Castling moves the rook from its corner, so each right needs the king
+  //  and that rook still on their home squares
+  const int E1 = A1 + 4 * RIGHT;
+  const int E8 = A8 + 4 * RIGHT;
+  if (((_castling_rights & CASTLING_BIT(WHITE, KING_SIDE)) && (_board[E1] != KING || _board[H1] != ROOK))
+      || ((_castling_rights & CASTLING_BIT(WHITE, QUEEN_SIDE)) && (_board[E1] != KING || _board[A1] != ROOK))
+      || ((_castling_rights & CASTLING_BIT(BLACK, KING_SIDE)) && (_board[E8] != -KING || _board[H8] != -ROOK))
+      || ((_castling_rights & CASTLING_BIT(BLACK, QUEEN_SIDE)) && (_board[E8] != -KING || _board[A8] != -ROOK))) {
+    return FEN_BAD_CASTLING;
+  }
 
-  _half_moves = std::stoi(half_moves_str);
-  _full_moves = std::stoi(full_moves_str);
-  _color_to_play = color_to_play_str.compare("w") ? BLACK : WHITE;
-  _en_passant_square = en_passant_sq_str.compare("-")
-    ? get_pos_rankfile(en_passant_sq_str)
-    : NO_SQUARE;
-  _castling_rights = new bool*[2]();
-  _castling_rights[WHITE] = new bool[2]();
-  _castling_rights[BLACK] = new bool[2]();
-  _castling_rights[WHITE][QUEEN_SIDE] = 
-    castling_rights_str.find("Q", 0) != std::string::npos;
-  _castling_rights[WHITE][KING_SIDE] =
-    castling_rights_str.find("K", 0) != std::string::npos;
-  _castling_rights[BLACK][QUEEN_SIDE] =
-    castling_rights_str.find("q", 0) != std::string::npos;
-  _castling_rights[BLACK][KING_SIDE] =
-    castling_rights_str.find("k", 0) != std::string::npos;
+  std::string_view en_passant = next_fen_field(rest);
+  if (en_passant == "-") {
+    _en_passant_square = NO_SQUARE;
+  } else if (en_passant.size() == 2 && en_passant[0] >= 'a' && en_passant[0] <= 'h'
+             && en_passant[1] == (_color_to_play == WHITE ? '6' : '3')) {
+    _en_passant_square = A1 + (en_passant[0] - 'a') * RIGHT + (en_passant[1] - '1') * UP;
+    // The pawn that just pushed two squares must be in front of it, since
+    //  capturing en passant removes whatever is there
+    int pushed = _en_passant_square + (_color_to_play == WHITE ? DOWN : UP);
+    if (_board[_en_passant_square] != EMPTY || _board[pushed] != (_color_to_play == WHITE ? -PAWN : PAWN)) {
+      return FEN_BAD_EN_PASSANT;
+    }
+  } else {
+    return FEN_BAD_EN_PASSANT;
+  }
 
-  _VALID_ATTACKS = _generate_valid_attacks();
+  std::string_view half_moves = next_fen_field(rest);
+  std::string_view full_moves = next_fen_field(rest);
+  _half_moves = 0;
+  _full_moves = 1;
+  if ((!half_moves.empty() && !parse_fen_number(half_moves, _half_moves))
+      || (!full_moves.empty() && !parse_fen_number(full_moves, _full_moves))) {
+    return FEN_BAD_CLOCKS;
+  }
+  _hash = computeHash();
+  return FEN_OK;
 }
 
-// Move operator (Transfer of ownership when using the asisgnment operator)
-Board& Board::operator=(Board other) {
-  delete[] this->_board;
-  memcpy(this, &other, sizeof(Board));
-  other._board = NULL;
-  return *this;
-}
+// Plays the move if it is legal, else says why not. Legal moves are found by
+//  generating the moves of the piece on src. The error cases work harder to
+//  tell the reasons apart, but only run for moves that are rejected anyway.
+MoveResult Board::tryMove(int src, int dest, int promotion) {
+  if (src < 0 || src >= BOARD_ARR_LEN || _board[src] == OUTOFBOUNDS || _board[src] == EMPTY
+      || (_board[src] > 0) != (_color_to_play == WHITE)) {
+    return MOVE_NO_PIECE;
+  }
+  if (dest < 0 || dest >= BOARD_ARR_LEN || _board[dest] == OUTOFBOUNDS) {
+    return MOVE_BAD_DESTINATION;
+  }
+  int p = _board[src];
+  if (promotion != NO_PROMOTION) {
+    if (std::abs(promotion) < KNIGHT || std::abs(promotion) > QUEEN) {
+      return MOVE_BAD_PROMOTION;
+    }
+    // Only promote to a piece of the pawn's own color
+    promotion = p > 0 ? std::abs(promotion) : -std::abs(promotion);
+  }
 
-// Destructor
-Board::~Board() {
-  delete[] _castling_rights[WHITE];
-  delete[] _castling_rights[BLACK];
-  delete[] _castling_rights;
-  delete[] _board;
-  _board = NULL;
-}
+  Move move(src, dest, promotion);
+  MoveList moves;
+  _generate_bitboard_moves(moves, GEN_ALL, SQ_BB(SQ64(src)));
+  bool reaches_dest = false;
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    if (moves[i] == move) {
+      Undo undo;
+      doMove(move, undo);
+      return MOVE_OK;
+    }
+    reaches_dest |= moves[i].dest == dest;
+  }
 
-// Overloaded makeMove function for convenience when not promoting
-void Board::makeMove(int src, int dest) {
-  this->makeMove(src, dest, NO_PROMOTION);
+  if (reaches_dest) {
+    return MOVE_BAD_PROMOTION;  // Missing, or given for a move that doesn't promote
+  }
+  if ((p == KING || p == -KING) && (dest - src == 2 * RIGHT || dest - src == 2 * LEFT)) {
+    return MOVE_BAD_CASTLING;
+  }
+  // Moves the piece can make, but which leave its own king attacked
+  MoveList pseudo_moves;
+  _generate_mailbox_moves(pseudo_moves);
+  for (uint32_t i = 0; i < pseudo_moves.size(); i++) {
+    if (pseudo_moves[i].src == src && pseudo_moves[i].dest == dest) {
+      return MOVE_LEAVES_KING_IN_CHECK;
+    }
+  }
+  return MOVE_BAD_DESTINATION;
 }
 
-// Moves a piece from src to dest if legal to do so.
-// TODO: Some illegal moves do nothing, some illegal moves assert failure. Should be consistent
-// TODO: How to make this more efficient?
-void Board::makeMove(int src, int dest, int promotion) {
+// Plays the move, trusting that it is legal. Only the state that cannot be
+//  recovered from the move itself is saved in undo.
+void Board::doMove(const Move &move, Undo &undo) {
+  int src = move.src;
+  int dest = move.dest;
   int p = _board[src];
   int q = _board[dest];
-  if (_color_to_play == WHITE && !(p >= PAWN && p <= KING)) {
-    std::cout << "Must move a white piece" << std::endl;
-    assert(false);
-    return;
-  } else if (_color_to_play == BLACK && !(p <= -PAWN && p >= -KING)) {
-    assert(false);
-    std::cout << "Must move a black piece" << std::endl;
-    return;
+
+  undo.captured = q;
+  undo.en_passant_square = _en_passant_square;
+  undo.castling_rights = _castling_rights;
+  undo.half_moves = _half_moves;
+  undo.white_king_sq = _white_king_sq;
+  undo.black_king_sq = _black_king_sq;
+  undo.hash = _hash;
+
+  // Take the old castling rights and en passant square out of the hash
+  _hash ^= ZOBRIST_CASTLING[_castling_rights] ^ _en_passant_key();
+
+  if (q != EMPTY) {
+    _remove_piece(dest);
   }
+  _remove_piece(src);
+  _put_piece(dest, move.promotion == NO_PROMOTION ? p : move.promotion);
 
-  // Castling
-  if (p == KING && src == A1 + (RIGHT*4) && dest == A1 + (RIGHT*6)) {
-    // White king-side castle
-    if (!_castling_rights[WHITE][KING_SIDE]
-        || _board[A1 + (5*RIGHT)] != EMPTY
-        || _board[A1 + (6*RIGHT)] != EMPTY) {
-      return;
+  if (p == KING || p == -KING) {
+    // Update our cached king positions
+    if (p == KING) {
+      _white_king_sq = dest;
+    } else {
+      _black_king_sq = dest;
     }
-    if (Board::_attacked(_white_king_sq, BLACK)  // FIXME: Factor out common check
-        || Board::_attacked(_white_king_sq + RIGHT, BLACK)
-        || Board::_attacked(_white_king_sq + 2*RIGHT, BLACK)) {
-      std::cout << "Cannot castle out of, or through check" << std::endl;
-      return;
+    // A king moving two squares is castling, so bring the rook across it
+    if (dest - src == 2 * RIGHT) {
+      _put_piece(dest + LEFT, _board[dest + RIGHT]);
+      _remove_piece(dest + RIGHT);
+    } else if (dest - src == 2 * LEFT) {
+      _put_piece(dest + RIGHT, _board[dest + 2 * LEFT]);
+      _remove_piece(dest + 2 * LEFT);
     }
-    _board[dest] = p;
-    _board[src] = EMPTY;
-    _board[H1] = EMPTY;
-    _board[H1-(2*RIGHT)] = ROOK;
-    _castling_rights[WHITE][KING_SIDE] = false;
-    _castling_rights[WHITE][QUEEN_SIDE] = false;
-    _en_passant_square = NO_SQUARE;  // TODO: Consolidate this with the later check?
-    _white_king_sq = dest;
-  } else if (p == KING && src == A1 + (4*RIGHT) && dest == A1 + (2*RIGHT)) {
-    // White queen-side castle
-    if (!_castling_rights[WHITE][QUEEN_SIDE]
-        || _board[A1 + (RIGHT)] != EMPTY
-        || _board[A1 + (2*RIGHT)] != EMPTY 
-        || _board[A1 + (3*RIGHT)] != EMPTY) {
-      return;
+  }
+
+  // en passant capture
+  // Because the ep square is only set after a pawn double push
+  //  then a pawn capturing the ep square must be in an adjacent
+  //  file, so we can blindly remove the piece behind ep square
+  if (dest == _en_passant_square) {
+    if (p == PAWN) {
+      _remove_piece(dest + DOWN);
+    } else if (p == -PAWN) {
+      _remove_piece(dest + UP);
     }
-    if (Board::_attacked(_white_king_sq, BLACK)  // FIXME: Factor out common check
-        || Board::_attacked(_white_king_sq + LEFT, BLACK)
-        || Board::_attacked(_white_king_sq + 2*LEFT, BLACK)) {
-      std::cout << "Cannot castle out of, or through check" << std::endl;
-      return;
+  }
+
+  // If it is a pawn push, set the en passant square
+  if (p == PAWN && dest - src == 2 * UP) {
+    _en_passant_square = src + UP;
+  } else if (p == -PAWN && dest - src == 2 * DOWN) {
+    _en_passant_square = src + DOWN;
+  } else {
+    _en_passant_square = NO_SQUARE;
+  }
+
+  // Set castling rights. Moving a king or rook, or having a rook captured
+  //  on its home square, loses the right to castle with it
+  if (p == KING || src == A1 || dest == A1) {
+    _castling_rights &= ~CASTLING_BIT(WHITE, QUEEN_SIDE);
+  }
+  if (p == KING || src == H1 || dest == H1) {
+    _castling_rights &= ~CASTLING_BIT(WHITE, KING_SIDE);
+  }
+  if (p == -KING || src == A8 || dest == A8) {
+    _castling_rights &= ~CASTLING_BIT(BLACK, QUEEN_SIDE);
+  }
+  if (p == -KING || src == H8 || dest == H8) {
+    _castling_rights &= ~CASTLING_BIT(BLACK, KING_SIDE);
+  }
+
+  // Increment full-move counter
+  if (_color_to_play == BLACK) {
+    _full_moves++;
+  }
+
+  if (p == PAWN || p == -PAWN || q != EMPTY) {
+    _half_moves = 0;
+  } else {
+    _half_moves++;
+  }
+
+  _color_to_play = _color_to_play == WHITE ? BLACK : WHITE;
+  _hash ^= ZOBRIST_CASTLING[_castling_rights] ^ ZOBRIST_BLACK_TO_PLAY ^ _en_passant_key();
+
+#ifdef HASH_DEBUG
+  assert(_hash == computeHash());
+#endif
+}
+
+// Takes back a move by reversing each step of doMove
+void Board::undoMove(const Move &move, const Undo &undo) {
+  int src = move.src;
+  int dest = move.dest;
+
+  _color_to_play = _color_to_play == WHITE ? BLACK : WHITE;
+  if (_color_to_play == BLACK) {
+    _full_moves--;
+  }
+
+  // A promoted piece turns back into the pawn which moved
+  int p = _board[dest];
+  if (move.promotion != NO_PROMOTION) {
+    p = move.promotion > 0 ? PAWN : -PAWN;
+  }
+  _remove_piece(dest);
+  _put_piece(src, p);
+  if (undo.captured != EMPTY) {
+    _put_piece(dest, undo.captured);
+  }
+
+  // Put the rook back in the corner after castling
+  if (p == KING || p == -KING) {
+    if (dest - src == 2 * RIGHT) {
+      _put_piece(dest + RIGHT, _board[dest + LEFT]);
+      _remove_piece(dest + LEFT);
+    } else if (dest - src == 2 * LEFT) {
+      _put_piece(dest + 2 * LEFT, _board[dest + RIGHT]);
+      _remove_piece(dest + RIGHT);
     }
-    _board[dest] = p;
-    _board[src] = EMPTY;
-    _board[A1] = EMPTY;
-    _board[A1+(3*RIGHT)] = ROOK;
-    _castling_rights[WHITE][KING_SIDE] = false;
-    _castling_rights[WHITE][QUEEN_SIDE] = false;
-    _en_passant_square = NO_SQUARE;  // TODO: Consolidate this with the later check?
-    _white_king_sq = dest;
-  } else if (p == -KING && src == A8 + (4*RIGHT) && dest == A8 + (6*RIGHT)) {
-    // Black king-side castle
-    if (!_castling_rights[BLACK][KING_SIDE]
-        || _board[A8 + (5*RIGHT)] != EMPTY
-        || _board[A8 + (6*RIGHT)] != EMPTY) {
-      return;
+  }
+
+  // Return the pawn captured en passant
+  if (dest == undo.en_passant_square) {
+    if (p == PAWN) {
+      _put_piece(dest + DOWN, -PAWN);
+    } else if (p == -PAWN) {
+      _put_piece(dest + UP, PAWN);
     }
-    if (Board::_attacked(_black_king_sq, WHITE) // FIXME: Factor out common check
-        || Board::_attacked(_black_king_sq + RIGHT, WHITE)
-        || Board::_attacked(_black_king_sq + 2*RIGHT, WHITE)) {
-      std::cout << "Cannot castle out of, or through check" << std::endl;
-      return;
+  }
+
+  _en_passant_square = undo.en_passant_square;
+  _castling_rights = undo.castling_rights;
+  _half_moves = undo.half_moves;
+  _white_king_sq = undo.white_king_sq;
+  _black_king_sq = undo.black_king_sq;
+  _hash = undo.hash;
+
+#ifdef HASH_DEBUG
+  assert(_hash == computeHash());
+#endif
+}
+
+bool Board::inCheck() {
+  int king_sq = _color_to_play == WHITE ? _white_king_sq : _black_king_sq;
+  return _attacked(king_sq, !_color_to_play);
+}
+
+// Only positions since the last capture or pawn move can repeat, and only
+//  every other one has the same side to move, so most calls look at few keys
+int KeyHistory::repetitions(const Board &board) const {
+  int count = 0;
+  int distance = std::min({board.halfMoves(), _ply, KEY_HISTORY_LEN - 1});
+  for (int ply = _ply - 4; ply >= _ply - distance; ply -= 2) {
+    count += _keys[ply & (KEY_HISTORY_LEN - 1)] == board.hash();
+  }
+  return count;
+}
+
+bool Board::isDraw(const KeyHistory &history, int repetitions) {
+  if (_half_moves >= 100) {
+    // Unless the move that made it 100 was checkmate
+    return !inCheck() || !generateMoves().empty();
+  }
+  return history.repetitions(*this) >= repetitions || _insufficient_material();
+}
+
+bool Board::_insufficient_material() const {
+  if (_pieces[WHITE][PAWN] | _pieces[BLACK][PAWN] | _pieces[WHITE][ROOK] | _pieces[BLACK][ROOK]
+      | _pieces[WHITE][QUEEN] | _pieces[BLACK][QUEEN]) {
+    return false;
+  }
+  Bitboard knights = _pieces[WHITE][KNIGHT] | _pieces[BLACK][KNIGHT];
+  Bitboard bishops = _pieces[WHITE][BISHOP] | _pieces[BLACK][BISHOP];
+  if (popcount(knights | bishops) <= 1) {
+    return true;
+  }
+  // Bishops that all stand on one color of square can never give mate
+  return knights == EMPTY_BB && ((bishops & DARK_SQUARES_BB) == EMPTY_BB || (bishops & ~DARK_SQUARES_BB) == EMPTY_BB);
+}
+
+// Hash key for the en passant square, which only counts when the side to move
+//  has a pawn that could capture on it. Otherwise positions reached with and
+//  without a double push would hash differently though the same moves follow
+uint64_t Board::_en_passant_key() {
+  if (_en_passant_square == NO_SQUARE) {
+    return 0;
+  }
+  int ep_sq = SQ64(_en_passant_square);
+  if (PAWN_ATTACKS[!_color_to_play][ep_sq] & _pieces[_color_to_play][PAWN]) {
+    return ZOBRIST_EN_PASSANT[ep_sq % 8];
+  }
+  return 0;
+}
+
+// Computes the hash of the position from scratch
+uint64_t Board::computeHash() {
+  uint64_t hash = 0;
+  for (int color = WHITE; color <= BLACK; color++) {
+    for (int piece = PAWN; piece <= KING; piece++) {
+      Bitboard pieces = _pieces[color][piece];
+      while (pieces) {
+        hash ^= ZOBRIST_PIECES[color][piece][pop_lsb(pieces)];
+      }
     }
-    _board[dest] = p;
-    _board[src] = EMPTY;
-    _board[H8] = EMPTY;
-    _board[H8-(2*RIGHT)] = -ROOK;
-    _castling_rights[BLACK][QUEEN_SIDE] = false;
-    _castling_rights[BLACK][KING_SIDE] = false;
-    _en_passant_square = NO_SQUARE;  // TODO: Consolidate this with the later check?
-    _black_king_sq = dest;
-  } else if (p == -KING && src == A8 + (4*RIGHT) && dest == A8 + (2*RIGHT)) {
-    // Black queen-side castle
-    if (!_castling_rights[BLACK][QUEEN_SIDE]
-        || _board[A8 + (RIGHT)] != EMPTY
-        || _board[A8 + (2*RIGHT)] != EMPTY 
-        || _board[A8 + (3*RIGHT)] != EMPTY) {
-      return;
+  }
+  hash ^= ZOBRIST_CASTLING[_castling_rights] ^ _en_passant_key();
+  if (_color_to_play == BLACK) {
+    hash ^= ZOBRIST_BLACK_TO_PLAY;
+  }
+  return hash;
+}
+
+// Places piece on the empty square sq
+void Board::_put_piece(int sq, int piece) {
+  Bitboard b = SQ_BB(SQ64(sq));
+  int color = piece > 0 ? WHITE : BLACK;
+  _board[sq] = piece;
+  _pieces[color][piece > 0 ? piece : -piece] |= b;
+  _occupied[color] |= b;
+  _hash ^= ZOBRIST_PIECES[color][piece > 0 ? piece : -piece][SQ64(sq)];
+  _mg_score += EVAL_MG[color][piece > 0 ? piece : -piece][SQ64(sq)];
+  _eg_score += EVAL_EG[color][piece > 0 ? piece : -piece][SQ64(sq)];
+  _phase += PHASE_WEIGHTS[piece > 0 ? piece : -piece];
+}
+
+// Empties the occupied square sq
+void Board::_remove_piece(int sq) {
+  Bitboard b = SQ_BB(SQ64(sq));
+  int piece = _board[sq];
+  int color = piece > 0 ? WHITE : BLACK;
+  _board[sq] = EMPTY;
+  _pieces[color][piece > 0 ? piece : -piece] ^= b;
+  _occupied[color] ^= b;
+  _hash ^= ZOBRIST_PIECES[color][piece > 0 ? piece : -piece][SQ64(sq)];
+  _mg_score -= EVAL_MG[color][piece > 0 ? piece : -piece][SQ64(sq)];
+  _eg_score -= EVAL_EG[color][piece > 0 ? piece : -piece][SQ64(sq)];
+  _phase -= PHASE_WEIGHTS[piece > 0 ? piece : -piece];
+}
+
+// Generate all possible legal moves for the current board
+MoveList Board::generateMoves(GenType type) {
+  MoveList moves;
+  generateMoves(moves, type);
+  return moves;
+}
+
+void Board::generateMoves(MoveList &moves, GenType type) {
+  moves.clear();
+
+  // The bitboard generator only produces legal moves
+  if (_generator == BITBOARD_GENERATOR) {
+    _generate_bitboard_moves(moves, type, ~EMPTY_BB);
+    return;
+  }
+
+  if (type == GEN_EVASIONS && !inCheck()) {
+    return;
+  }
+
+  MoveList pseudo_moves;
+  _generate_mailbox_moves(pseudo_moves);
+  _generate_castling_moves(pseudo_moves);
+
+  // Filter out illegal pseudo-moves that would leave/put the player in check.
+  //  Each move is played and taken back in place on this board.
+  int color = _color_to_play;
+  bool quiet_only = type == GEN_QUIETS || type == GEN_QUIET_CHECKS;
+  for (uint32_t i = 0; i < pseudo_moves.size(); i++) {
+    bool capture = isCaptureOrPromotion(pseudo_moves[i]);
+    if ((type == GEN_CAPTURES && !capture) || (quiet_only && capture)) {
+      continue;
     }
-    if (Board::_attacked(_black_king_sq, WHITE)  // FIXME: Factor out common check
-        || Board::_attacked(_black_king_sq + LEFT, WHITE)
-        || Board::_attacked(_black_king_sq + 2*LEFT, WHITE)) {
-      std::cout << "Cannot castle out of, or through check" << std::endl;
-      return;
+    Undo undo;
+    doMove(pseudo_moves[i], undo);
+    if (((color == WHITE && !_attacked(_white_king_sq, BLACK)) ||
+         (color == BLACK && !_attacked(_black_king_sq, WHITE))) &&
+        (type != GEN_QUIET_CHECKS || inCheck())) {
+      moves.push_back(pseudo_moves[i]);
     }
-    _board[dest] = p;
-    _board[src] = EMPTY;
-    _board[A8] = EMPTY;
-    _board[A8+(3*RIGHT)] = -ROOK;
-    _castling_rights[BLACK][QUEEN_SIDE] = false;
-    _castling_rights[BLACK][KING_SIDE] = false;
-    _en_passant_square = NO_SQUARE;  // TODO: Consolidate this with the later check?
-    _black_king_sq = dest;
-    // FIXME: Make castling less verbose
-    // End Castling  //
-  } else {
-    // Non castling moves
+    undoMove(pseudo_moves[i], undo);
+  }
+}
 
-    // Check whether the piece moves the way it is being asked to
-    // Simply returns whether the proposed move follows the move set defined fo this piece
-    if (!_attacks(p, src, dest)) {
-      std::cout << "Piece cannot be moved there" << std::endl;
-      assert(false);
-      return;
+// Whether move is legal in this position. Only the moves of the piece on
+//  move.src are generated to check, so this is cheap enough to validate
+//  moves remembered from other positions, like hash moves and killers
+bool Board::isLegal(const Move &move) {
+  if (move.src < A1 || move.src > H8 || _board[move.src] == OUTOFBOUNDS ||
+      _board[move.src] == EMPTY || (_board[move.src] > 0) != (_color_to_play == WHITE)) {
+    return false;
+  }
+  MoveList moves;
+  _generate_bitboard_moves(moves, GEN_ALL, SQ_BB(SQ64(move.src)));
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    if (moves[i] == move) {
+      return true;
     }
+  }
+  return false;
+}
 
-    // Pawns move differently than they attack, but our pawn move-sets include both.
-    //  So here we have to do an extra check to check that a proposed capture by a
-    //  pawn is diagonally.
-    if (p == PAWN || p == -PAWN) {
-      if ((dest - src) % UP == 0) {
-        if (q != EMPTY) {
-          std::cout << "Pawn's cannot attack that way" << std::endl;
-          assert(false);
-          return;
-        }
-      }
-    }
+// Whether move captures a piece or promotes a pawn
+bool Board::isCaptureOrPromotion(const Move &move) const {
+  int p = _board[move.src];
+  return _board[move.dest] != EMPTY || move.promotion != NO_PROMOTION
+    || ((p == PAWN || p == -PAWN) && move.dest == _en_passant_square);
+}
 
-    // If this move would be a capture, verify it would be a capture of an opposing color
-    if (q != EMPTY && q * p > 0) {
-      std::cout << "Cannot capture piece of same color" << std::endl; 
-      assert(false);
-      return;
+int Board::see(const Move &move) {
+  int us = _color_to_play;
+  int to = SQ64(move.dest);
+  Bitboard occupied = (_occupied[WHITE] | _occupied[BLACK]) ^ SQ_BB(SQ64(move.src));
+  int piece = std::abs(_board[move.src]);
+
+  // gain[d] is what the side making capture d wins if the exchange stops after it
+  int gain[32];
+  int d = 0;
+  gain[0] = PIECE_VALUES[std::abs(_board[move.dest])];
+  if (piece == PAWN && move.dest == _en_passant_square) {
+    gain[0] = PIECE_VALUES[PAWN];
+    occupied ^= SQ_BB(to + (us == WHITE ? -8 : 8));
+  }
+  if (move.promotion != NO_PROMOTION) {
+    piece = std::abs(move.promotion);
+    gain[0] += PIECE_VALUES[piece] - PIECE_VALUES[PAWN];
+  }
+
+  // Sliders behind a capturing piece join in once it has left, so the
+  //  attackers are looked up again on the new occupancy each time
+  int side = !us;
+  while (d < 31) {
+    Bitboard attackers = (_attackers_to(to, WHITE, occupied) | _attackers_to(to, BLACK, occupied)) & occupied;
+    Bitboard ours = attackers & _occupied[side];
+    if (!ours) {
+      break;
+    }
+    int attacker = PAWN;
+    while (!(ours & _pieces[side][attacker])) {
+      attacker++;
     }
+    // The king may only take last, when nothing can take it back
+    if (attacker == KING && (attackers & _occupied[!side])) {
+      break;
+    }
+    d++;
+    gain[d] = PIECE_VALUES[piece] - gain[d - 1];
+    occupied ^= SQ_BB(lsb(ours & _pieces[side][attacker]));
+    piece = attacker;
+    side = !side;
+  }
 
-    // If the pawn would move to the last rank, ensure the move involved promotion.
-    if ((p == -PAWN && dest > A8 && dest < H8) ||
-        (p == PAWN  && dest > A1 && dest < H1)) {
-      if (promotion != -KNIGHT && promotion != KNIGHT && promotion != QUEEN && promotion != -QUEEN &&
-          promotion != ROOK && promotion != -ROOK && promotion != BISHOP && promotion != -BISHOP) {
-        assert(false);
-        return;  // Pawn must be promoted
+  // Either side may stop capturing instead of losing material
+  while (d > 0) {
+    gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    d--;
+  }
+  return gain[0];
+}
+
+std::string Board::toSan(const Move &move) {
+  std::string san;
+  int p = std::abs(_board[move.src]);
+  int delta = move.dest - move.src;
+  bool capture = _board[move.dest] != EMPTY || (p == PAWN && move.dest == _en_passant_square);
+
+  if (p == KING && (delta == 2 * RIGHT || delta == 2 * LEFT)) {
+    san = delta > 0 ? "O-O" : "O-O-O";
+  } else if (p == PAWN) {
+    if (capture) {
+      san += sq_name(move.src)[0];
+      san += 'x';
+    }
+    san += sq_name(move.dest);
+    if (move.promotion != NO_PROMOTION) {
+      san += '=';
+      san += get_symbol(std::abs(move.promotion));
+    }
+  } else {
+    san += get_symbol(p);
+    // Name the file, rank, or both, of the source when another piece of
+    //  the same kind could also move to the destination
+    bool ambiguous = false;
+    bool same_file = false;
+    bool same_rank = false;
+    MoveList moves = generateMoves();
+    for (uint32_t i = 0; i < moves.size(); i++) {
+      if (moves[i].dest == move.dest && moves[i].src != move.src
+          && _board[moves[i].src] == _board[move.src]) {
+        ambiguous = true;
+        same_file |= (moves[i].src - A1) % UP == (move.src - A1) % UP;
+        same_rank |= (moves[i].src - A1) / UP == (move.src - A1) / UP;
+      }
+    }
+    if (ambiguous) {
+      std::string src = sq_name(move.src);
+      if (!same_file) {
+        san += src[0];
+      } else if (!same_rank) {
+        san += src[1];
+      } else {
+        san += src;
       }
     }
+    if (capture) {
+      san += 'x';
+    }
+    san += sq_name(move.dest);
+  }
 
-    // Prepare to undo the move by saving copies of certain state
-    // TODO: Is there a way to undo a move that does not involve just backing up the entire board/data?
-    int *backup = new int[BOARD_ARR_LEN];
-    int backup_white_king_sq = _white_king_sq;  // FIXME: It's a little awkward/unclear why we have to save only these three
-    int backup_black_king_sq = _black_king_sq;
-    std::copy(_board, _board+BOARD_ARR_LEN, backup);
+  Undo undo;
+  doMove(move, undo);
+  if (inCheck()) {
+    san += generateMoves().empty() ? '#' : '+';
+  }
+  undoMove(move, undo);
+  return san;
+}
 
-    //
-    // Make Move
-    //
-    _board[dest] = p;
-    _board[src] = EMPTY;
+// Square named by text like "e4", or NO_SQUARE
+static int parse_square(std::string_view text) {
+  if (text.size() != 2 || text[0] < 'a' || text[0] > 'h' || text[1] < '1' || text[1] > '8') {
+    return NO_SQUARE;
+  }
+  return A1 + (text[0] - 'a') * RIGHT + (text[1] - '1') * UP;
+}
 
-    // Update our cached king positions
-    if (p == KING) {
-      _white_king_sq = dest;
-    } else if (p == -KING) {
-      _black_king_sq = dest;
-    }
+// Piece type a pawn promotes to, from either case of its letter, or EMPTY
+static int promotion_piece(char symbol) {
+  switch (symbol) {
+    case 'q': case 'Q': return QUEEN;
+    case 'r': case 'R': return ROOK;
+    case 'b': case 'B': return BISHOP;
+    case 'n': case 'N': return KNIGHT;
+  }
+  return EMPTY;
+}
 
-    // en passant capture
-    // Because the ep square is only set after a pawn double push
-    //  then a pawn capturing the ep square must be in an adjacent
-    //  file, so we can blindly remove the piece behind ep square
-    if (dest == _en_passant_square) {
-      if (p == PAWN) {
-        _board[dest + DOWN] = EMPTY;
-      } else if (p == -PAWN) {
-        _board[dest + UP] = EMPTY;
-      }
+std::string move_to_uci(const Move &move) {
+  if (move == NO_MOVE) {
+    return "0000";
+  }
+  std::string text = sq_name(move.src) + sq_name(move.dest);
+  if (move.promotion != NO_PROMOTION) {
+    text += get_symbol(-std::abs(move.promotion));
+  }
+  return text;
+}
+
+// Trusted moves are decoded straight from the text. Castling needs nothing
+//  special, since UCI writes it as the king's move
+Move Board::parseUci(std::string_view text, ReplayMode mode) {
+  if (text.size() != 4 && text.size() != 5) {
+    return NO_MOVE;
+  }
+  int src = parse_square(text.substr(0, 2));
+  int dest = parse_square(text.substr(2, 2));
+  if (src == NO_SQUARE || dest == NO_SQUARE) {
+    return NO_MOVE;
+  }
+  int p = _board[src];
+  if (p == EMPTY || (p > 0) != (_color_to_play == WHITE)) {
+    return NO_MOVE;
+  }
+  // Even a trusted move must not land on one of the mover's pieces (which
+  //  includes not moving at all) or on a king, as doMove would then take
+  //  the wrong piece off the board
+  int q = _board[dest];
+  if ((q != EMPTY && (q > 0) == (p > 0)) || q == KING || q == -KING) {
+    return NO_MOVE;
+  }
+  int promotion = NO_PROMOTION;
+  if (text.size() == 5) {
+    int piece = promotion_piece(text[4]);
+    if (piece == EMPTY) {
+      return NO_MOVE;
     }
+    promotion = p > 0 ? piece : -piece;
+  }
+  Move move(src, dest, promotion);
+  if (mode == REPLAY_VALIDATE && !isLegal(move)) {
+    return NO_MOVE;
+  }
+  return move;
+}
 
-    // Undo a move if the player put themselves in check, or didn't evade check
-    if ((_color_to_play == WHITE && _attacked(_white_king_sq, BLACK))
-        || (_color_to_play == BLACK && _attacked(_black_king_sq, WHITE))) {
-      //std::cout << "King must not be in check" << std::endl;
-      delete[] _board;
-      _board = backup;
-      _white_king_sq = backup_white_king_sq;
-      _black_king_sq = backup_black_king_sq;
-      return;
-    } else {
-      delete[] backup;
+Move Board::parseSan(std::string_view text, ReplayMode mode) {
+  size_t end = text.find_last_not_of("+#!?");
+  if (end == std::string_view::npos) {
+    return NO_MOVE;
+  }
+  text = text.substr(0, end + 1);
+  int color = _color_to_play;
+  int king_sq = color == WHITE ? _white_king_sq : _black_king_sq;
+  if (text == "O-O" || text == "0-0") {
+    return _find_move(_pieces[color][KING], king_sq + 2 * RIGHT, NO_PROMOTION, mode);
+  } else if (text == "O-O-O" || text == "0-0-0") {
+    return _find_move(_pieces[color][KING], king_sq + 2 * LEFT, NO_PROMOTION, mode);
+  }
+
+  int piece = PAWN;
+  if (!text.empty() && std::string_view("NBRQK").find(text[0]) != std::string_view::npos) {
+    piece = symbol_to_piece(text[0]);
+    text.remove_prefix(1);
+  }
+  // Promotions are written "e8=Q", or sometimes "e8Q"
+  int promotion = NO_PROMOTION;
+  if (piece == PAWN && text.size() >= 3) {
+    size_t equals = text.find('=');
+    if (equals != std::string_view::npos) {
+      promotion = equals + 2 == text.size() ? promotion_piece(text[equals + 1]) : EMPTY;
+      text = text.substr(0, equals);
+    } else if (std::string_view("QRBN").find(text.back()) != std::string_view::npos) {
+      promotion = promotion_piece(text.back());
+      text.remove_suffix(1);
+    }
+    if (promotion == EMPTY) {
+      return NO_MOVE;
     }
+  }
+  if (text.size() < 2) {
+    return NO_MOVE;
+  }
+  int dest = parse_square(text.substr(text.size() - 2));
+  if (dest == NO_SQUARE) {
+    return NO_MOVE;
+  }
+  text.remove_suffix(2);
+  if (!text.empty() && text.back() == 'x') {
+    text.remove_suffix(1);
+  }
 
-    // If it is a pawn push, set the en passant square
-    if (p == PAWN && dest - src == 2 * UP) {
-      _en_passant_square = src + UP;
-    } else if (p == -PAWN && dest - src == 2 * DOWN) {
-      _en_passant_square = src + DOWN;
+  // What is left names the file and/or rank of the source, if needed
+  Bitboard sources = _pieces[color][piece];
+  if (piece == PAWN && text.empty()) {
+    sources &= FILE_A_BB << (SQ64(dest) % 8);  // A push, so not a capture onto the same square
+  }
+  for (char c : text) {
+    if (c >= 'a' && c <= 'h') {
+      sources &= FILE_A_BB << (c - 'a');
+    } else if (c >= '1' && c <= '8') {
+      sources &= RANK_1_BB << (8 * (c - '1'));
     } else {
-      _en_passant_square = NO_SQUARE;
+      return NO_MOVE;
     }
+  }
+  return _find_move(sources, dest, promotion, mode);
+}
 
-    // Promotion
-    // if a pawn has made it to the end of its file (either through capture or pushing)
-    // it must be promoted
-    // TODO: Ensure people only promote to their own color
-    if ((p == -PAWN && dest > A8 && dest < H8) ||
-        (p == PAWN  && dest > A1 && dest < H1)) {
-      _board[dest] = promotion;
+Move Board::_find_move(Bitboard sources, int dest, int promotion, ReplayMode mode) {
+  if (sources == EMPTY_BB) {
+    return NO_MOVE;
+  }
+  MoveList moves;
+  _generate_bitboard_moves(moves, GEN_ALL, sources);
+  Move found = NO_MOVE;
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    if (moves[i].dest != dest || (promotion == NO_PROMOTION ? moves[i].promotion != NO_PROMOTION
+                                                             : std::abs(moves[i].promotion) != promotion)) {
+      continue;
     }
-
-    // Set castling rights
-    // TODO: Would it be better to invert this check? Check for castling rights, and then recheck that pieces haven't moved?
-    if ((p == ROOK && src == A1) || p == KING) {
-      _castling_rights[WHITE][QUEEN_SIDE] = false;
+    if (mode == REPLAY_TRUSTED) {
+      return moves[i];
+    } else if (found != NO_MOVE) {
+      return NO_MOVE;  // Ambiguous
     }
-    if ((p == ROOK && src == H1) || p == KING) {
-      _castling_rights[WHITE][KING_SIDE] = false;
+    found = moves[i];
+  }
+  return found;
+}
+
+// The moves are played with the unchecked doMove, since each one has
+//  already been checked as far as the mode asks
+bool Board::replayUci(std::string_view moves, ReplayMode mode, int *played, KeyHistory *history) {
+  int count = 0;
+  bool ok = true;
+  while (true) {
+    size_t start = moves.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) {
+      break;
     }
-    if ((p == -ROOK && src == A8) || p == -KING) {
-      _castling_rights[BLACK][QUEEN_SIDE] = false;
+    moves.remove_prefix(start);
+    std::string_view text = moves.substr(0, moves.find_first_of(" \t\r\n"));
+    moves.remove_prefix(text.size());
+    Move move = parseUci(text, mode);
+    if (move == NO_MOVE) {
+      ok = false;
+      break;
     }
-    if ((p == -ROOK && src == H8) || p == -KING) {
-      _castling_rights[BLACK][KING_SIDE] = false;
+    Undo undo;
+    doMove(move, undo);
+    if (history) {
+      history->push(_hash);
     }
+    count++;
   }
-
-  // Increment full-move counter
-  if (_color_to_play == BLACK) {
-    _full_moves++;
+  if (played) {
+    *played = count;
   }
+  return ok;
+}
 
-  // TODO: Implement checking for 50-move rule
-  if (p == PAWN || p == -PAWN || q != EMPTY) { // TODO: Does this capture all conditions where half moves are reset?
-    _half_moves = 0;
-  } else {
-    _half_moves++;
-  }
+bool Board::replaySan(std::string_view movetext, ReplayMode mode, int *played, KeyHistory *history) {
+  int count = 0;
+  bool ok = true;
+  int variation_depth = 0;
+  size_t i = 0;
+  while (i < movetext.size()) {
+    char c = movetext[i];
+    if (c == '{' || c == ';') {
+      // Comments run to the closing brace, or to the end of the line
+      size_t end = movetext.find(c == '{' ? '}' : '\n', i);
+      i = end == std::string_view::npos ? movetext.size() : end + 1;
+      continue;
+    } else if (c == '(' || c == ')') {
+      variation_depth += c == '(' ? 1 : -1;
+      i++;
+      continue;
+    } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      i++;
+      continue;
+    }
+    size_t end = movetext.find_first_of(" \t\r\n{}();", i);
+    std::string_view token = movetext.substr(i, end == std::string_view::npos ? end : end - i);
+    i += token.size();
+    if (variation_depth > 0) {
+      continue;
+    }
 
-  // TODO: Implement tracking for three-fold repetition.
+    // Move numbers ("12." or "12...") may be joined to the move after them
+    size_t digits = token.find_first_not_of("0123456789");
+    if (digits == std::string_view::npos) {
+      continue;
+    } else if (digits > 0 && token[digits] == '.') {
+      size_t move_start = token.find_first_not_of('.', digits);
+      if (move_start == std::string_view::npos) {
+        continue;
+      }
+      token.remove_prefix(move_start);
+    }
+    if (token[0] == '$' || token == "*" || token == "1-0" || token == "0-1" || token == "1/2-1/2") {
+      continue;
+    }
 
-  _color_to_play = _color_to_play == WHITE ? BLACK : WHITE;;
+    Move move = parseSan(token, mode);
+    if (move == NO_MOVE) {
+      ok = false;
+      break;
+    }
+    Undo undo;
+    doMove(move, undo);
+    if (history) {
+      history->push(_hash);
+    }
+    count++;
+  }
+  if (played) {
+    *played = count;
+  }
+  return ok;
 }
 
-// Generate all possible legal moves for the current board
-std::vector<Move> Board::generateMoves() {
-  std::vector<Move> pseudo_moves;
-  std::vector<Move> moves;
-
+// Generates pseudo-legal moves by walking the board array and
+//  sliding each piece along the directions it moves in
+void Board::_generate_mailbox_moves(MoveList &pseudo_moves) {
   // Loop over all squares and generate moves for each piece that can move
   for (int sq = A1; sq <= H8; sq++) {
     if (_board[sq] == OUTOFBOUNDS) {  // Skip out of bounds
@@ -510,35 +1053,43 @@ std::vector<Move> Board::generateMoves() {
         (_color_to_play == BLACK && p > 0 )) {  // Only pieces who's color turn it is
       continue;
     }
-    const std::vector<int> *move_set; // For current piece, its moves
+    const int *move_set = NULL; // For current piece, its moves
+    int num_moves = 0;
 
     // FIXME: Replace this with a static const map
     switch (p) {
       case PAWN: 
-        move_set = &WHITE_PAWN_MOVES;
+        move_set = WHITE_PAWN_MOVES;
+        num_moves = std::size(WHITE_PAWN_MOVES);
         break;
       case -PAWN:
-        move_set = &BLACK_PAWN_MOVES;
+        move_set = BLACK_PAWN_MOVES;
+        num_moves = std::size(BLACK_PAWN_MOVES);
         break;
       case KING:
       case -KING:
-        move_set = &KING_MOVES;
+        move_set = KING_MOVES;
+        num_moves = std::size(KING_MOVES);
         break;
       case BISHOP:
       case -BISHOP:
-        move_set = &BISHOP_MOVES;
+        move_set = BISHOP_MOVES;
+        num_moves = std::size(BISHOP_MOVES);
         break;
       case KNIGHT:
       case -KNIGHT:
-        move_set = &KNIGHT_MOVES;
+        move_set = KNIGHT_MOVES;
+        num_moves = std::size(KNIGHT_MOVES);
         break;
       case QUEEN:
       case -QUEEN:
-        move_set = &QUEEN_MOVES;
+        move_set = QUEEN_MOVES;
+        num_moves = std::size(QUEEN_MOVES);
         break;
       case ROOK:
       case -ROOK:
-        move_set = &ROOK_MOVES;
+        move_set = ROOK_MOVES;
+        num_moves = std::size(ROOK_MOVES);
       default:
         break;
     }
@@ -548,26 +1099,15 @@ std::vector<Move> Board::generateMoves() {
       // Pawn Pushing
       int push = p == PAWN ? UP : DOWN;
       bool home_rank = p == PAWN ? (sq <= H1 + UP) : (sq >= A8 + DOWN);  // Relies on fact Pawns are never behind their home rank
+      bool promoting = p == PAWN ? (sq >= A8 + DOWN) : (sq <= H1 + UP);
+      int targets[3];
+      int num_targets = 0;
       if (_board[sq + push] == EMPTY) {
-        pseudo_moves.push_back((Move){sq, sq+push, NO_PROMOTION});
+        targets[num_targets++] = sq + push;
         if (_board[sq + 2*push] == EMPTY && home_rank) {
-          pseudo_moves.push_back((Move){sq, sq+2*push, NO_PROMOTION});
+          pseudo_moves.push_back(Move(sq, sq+2*push, NO_PROMOTION));
         }
       }
-      // Pawn promotion
-      if (p == -PAWN && sq >= A1 + UP && sq <= H1 + UP && _board[sq+DOWN] == EMPTY) {  // Black promotion
-        pseudo_moves.push_back((Move){sq, sq+DOWN, -QUEEN});
-        pseudo_moves.push_back((Move){sq, sq+DOWN, -BISHOP});
-        pseudo_moves.push_back((Move){sq, sq+DOWN, -ROOK});
-        pseudo_moves.push_back((Move){sq, sq+DOWN, -KNIGHT});
-      }
-
-      if (p == PAWN && sq >= A8 + DOWN && sq <= H8 + DOWN && _board[sq+UP] == EMPTY) {  // White promotion
-        pseudo_moves.push_back((Move){sq, sq+UP, QUEEN});
-        pseudo_moves.push_back((Move){sq, sq+UP, BISHOP});
-        pseudo_moves.push_back((Move){sq, sq+UP, ROOK});
-        pseudo_moves.push_back((Move){sq, sq+UP, KNIGHT});
-      }
 
       // Pawn Captures
       int left_attack = sq + push + LEFT;
@@ -575,19 +1115,31 @@ std::vector<Move> Board::generateMoves() {
       if (_board[left_attack] != OUTOFBOUNDS &&
           (_board[left_attack]*p < 0 ||
            _en_passant_square == left_attack)) {
-        pseudo_moves.push_back((Move){sq, sq+push+LEFT, NO_PROMOTION});
+        targets[num_targets++] = left_attack;
       }
       if (_board[right_attack] != OUTOFBOUNDS &&
           (_board[right_attack]*p < 0 ||
            _en_passant_square == right_attack)) {
-        pseudo_moves.push_back((Move){sq, sq+push+RIGHT, NO_PROMOTION});
+        targets[num_targets++] = right_attack;
+      }
+
+      // Pawn promotion. Any push or capture onto the last rank must promote
+      for (int i = 0; i < num_targets; i++) {
+        if (promoting) {
+          pseudo_moves.push_back(Move(sq, targets[i], p*QUEEN));
+          pseudo_moves.push_back(Move(sq, targets[i], p*BISHOP));
+          pseudo_moves.push_back(Move(sq, targets[i], p*ROOK));
+          pseudo_moves.push_back(Move(sq, targets[i], p*KNIGHT));
+        } else {
+          pseudo_moves.push_back(Move(sq, targets[i], NO_PROMOTION));
+        }
       }
       continue;  // No further handling of pawn moves
     }
 
     // Loop through current piece's possible moves, and add any legal ones
-    for (uint32_t i = 0; i < move_set->size(); i++) {
-      int delta = (*move_set)[i];
+    for (int i = 0; i < num_moves; i++) {
+      int delta = move_set[i];
       int dest = sq;
 
       while (true) {  // To account for sliding, continue the current move until edge of board or another piece
@@ -597,14 +1149,14 @@ std::vector<Move> Board::generateMoves() {
           break;
         }
         if (q == EMPTY) {
-          pseudo_moves.push_back((Move){sq, dest, NO_PROMOTION});
+          pseudo_moves.push_back(Move(sq, dest, NO_PROMOTION));
         } else {
           // Only allow attacks on opposing color
           if ((_color_to_play == WHITE && q > 0) ||
               (_color_to_play == BLACK && q < 0)) {
             break;
           }
-          pseudo_moves.push_back((Move){sq, dest, NO_PROMOTION});
+          pseudo_moves.push_back(Move(sq, dest, NO_PROMOTION));
           break;
         }
         if (p == KNIGHT || p == -KNIGHT ||
@@ -614,9 +1166,196 @@ std::vector<Move> Board::generateMoves() {
       }
     }
   }
+}
+
+// Generates legal moves from the bitboards, looking up each piece's attacks
+//  in the precomputed tables. The checkers and pinned pieces are found once
+//  up front, so no move has to be played to see if it leaves the king in check.
+void Board::_generate_bitboard_moves(MoveList &moves, GenType type, Bitboard sources) {
+  int us = _color_to_play;
+  int them = !us;
+  Bitboard occupied = _occupied[WHITE] | _occupied[BLACK];
+  int king_sq = lsb(_pieces[us][KING]);
+  Bitboard checkers = _attackers_to(king_sq, them, occupied);
+  if (type == GEN_EVASIONS && !checkers) {
+    return;
+  }
+
+  // Squares a non-pawn move may land on for the type of moves wanted
+  bool quiet_only = type == GEN_QUIETS || type == GEN_QUIET_CHECKS;
+  Bitboard type_targets = type == GEN_CAPTURES ? _occupied[them]
+    : quiet_only ? ~occupied : ~_occupied[us];
+
+  // For quiet checks, the squares each piece gives check from, and the pieces
+  //  that uncover a check from one of our sliders by stepping off its line
+  Bitboard check_squares[KING + 1] = {};
+  Bitboard discoverers = EMPTY_BB;
+  int their_king_sq = lsb(_pieces[them][KING]);
+  if (type == GEN_QUIET_CHECKS) {
+    check_squares[PAWN] = PAWN_ATTACKS[them][their_king_sq];
+    check_squares[KNIGHT] = KNIGHT_ATTACKS[their_king_sq];
+    check_squares[BISHOP] = bishop_attacks(their_king_sq, occupied);
+    check_squares[ROOK] = rook_attacks(their_king_sq, occupied);
+    check_squares[QUEEN] = check_squares[BISHOP] | check_squares[ROOK];
+    check_squares[KING] = EMPTY_BB;
+    discoverers = _blockers(their_king_sq, us, occupied) & _occupied[us];
+  }
+
+  // The king may go anywhere not attacked once it has stepped off its square,
+  //  as sliders checking it also attack the squares behind it
+  Bitboard dests = KING_ATTACKS[king_sq] & type_targets & ~_occupied[us];
+  if (!(sources & SQ_BB(king_sq))) {
+    dests = EMPTY_BB;
+  }
+  if (type == GEN_QUIET_CHECKS) {
+    dests &= discoverers & SQ_BB(king_sq) ? ~LINE[their_king_sq][king_sq] : EMPTY_BB;
+  }
+  while (dests) {
+    int dest = pop_lsb(dests);
+    if (!_attackers_to(dest, them, occupied ^ SQ_BB(king_sq))) {
+      moves.push_back(Move(SQ256(king_sq), SQ256(dest), NO_PROMOTION));
+    }
+  }
+  // In double check only the king can move
+  if (popcount(checkers) > 1) {
+    return;
+  }
+
+  // Out of check any move will do, in check it must capture the checker or block it
+  Bitboard targets = ~_occupied[us];
+  if (checkers) {
+    targets &= checkers | BETWEEN[king_sq][lsb(checkers)];
+  }
+
+  // A piece is pinned if it is the only piece between the king and an enemy slider.
+  //  It may still move along the line between the two
+  Bitboard pinned = _blockers(king_sq, them, occupied) & _occupied[us];
+
+  // Pawns. Captures and promotions are GEN_CAPTURES moves, other pushes are GEN_QUIETS
+  Bitboard pawns = _pieces[us][PAWN] & sources;
+  Bitboard promotion_rank = us == WHITE ? RANK_8_BB : RANK_1_BB;
+  Bitboard double_push_rank = us == WHITE ? RANK_3_BB : RANK_6_BB;  // Rank after a single push from home
+  int push = us == WHITE ? 8 : -8;
+  int sign = us == WHITE ? 1 : -1;
+  int ep_sq = _en_passant_square == NO_SQUARE ? -1 : SQ64(_en_passant_square);
+  while (pawns) {
+    int sq = pop_lsb(pawns);
+    Bitboard pawn_dests = EMPTY_BB;
+    if (!quiet_only) {
+      pawn_dests |= PAWN_ATTACKS[us][sq] & _occupied[them];
+    }
+    Bitboard single = SQ_BB(sq + push) & ~occupied;
+    if (type == GEN_CAPTURES) {
+      pawn_dests |= single & promotion_rank;
+    } else {
+      pawn_dests |= single & (quiet_only ? ~promotion_rank : ~EMPTY_BB);
+      if (single & double_push_rank) {
+        pawn_dests |= SQ_BB(sq + 2 * push) & ~occupied;
+      }
+    }
+    pawn_dests &= targets;
+    if (pinned & SQ_BB(sq)) {
+      pawn_dests &= LINE[king_sq][sq];
+    }
+    if (type == GEN_QUIET_CHECKS) {
+      pawn_dests &= check_squares[PAWN] | (discoverers & SQ_BB(sq) ? ~LINE[their_king_sq][sq] : EMPTY_BB);
+    }
+
+    // En passant removes two pieces from the capturing pawn's rank, which can
+    //  uncover a check no pin test would find, so test it on the resulting occupancy
+    if (!quiet_only && ep_sq >= 0 && (PAWN_ATTACKS[us][sq] & SQ_BB(ep_sq))) {
+      int captured_sq = ep_sq - push;
+      Bitboard after = (occupied ^ SQ_BB(sq) ^ SQ_BB(captured_sq)) | SQ_BB(ep_sq);
+      if (!(_attackers_to(king_sq, them, after) & ~SQ_BB(captured_sq))) {
+        pawn_dests |= SQ_BB(ep_sq);
+      }
+    }
+
+    while (pawn_dests) {
+      int dest = pop_lsb(pawn_dests);
+      if (SQ_BB(dest) & promotion_rank) {
+        moves.push_back(Move(SQ256(sq), SQ256(dest), sign*QUEEN));
+        moves.push_back(Move(SQ256(sq), SQ256(dest), sign*BISHOP));
+        moves.push_back(Move(SQ256(sq), SQ256(dest), sign*ROOK));
+        moves.push_back(Move(SQ256(sq), SQ256(dest), sign*KNIGHT));
+      } else {
+        moves.push_back(Move(SQ256(sq), SQ256(dest), NO_PROMOTION));
+      }
+    }
+  }
+
+  // Pieces. A pinned knight can never move
+  for (int piece = KNIGHT; piece <= QUEEN; piece++) {
+    Bitboard pieces = _pieces[us][piece] & sources;
+    while (pieces) {
+      int sq = pop_lsb(pieces);
+      Bitboard piece_dests;
+      switch (piece) {
+        case KNIGHT:
+          piece_dests = KNIGHT_ATTACKS[sq];
+          break;
+        case BISHOP:
+          piece_dests = bishop_attacks(sq, occupied);
+          break;
+        case ROOK:
+          piece_dests = rook_attacks(sq, occupied);
+          break;
+        default:
+          piece_dests = queen_attacks(sq, occupied);
+          break;
+      }
+      piece_dests &= targets & type_targets;
+      if (pinned & SQ_BB(sq)) {
+        piece_dests &= LINE[king_sq][sq];
+      }
+      if (type == GEN_QUIET_CHECKS) {
+        piece_dests &= check_squares[piece] | (discoverers & SQ_BB(sq) ? ~LINE[their_king_sq][sq] : EMPTY_BB);
+      }
+      while (piece_dests) {
+        int dest = pop_lsb(piece_dests);
+        moves.push_back(Move(SQ256(sq), SQ256(dest), NO_PROMOTION));
+      }
+    }
+  }
+
+  if (!checkers && type != GEN_CAPTURES && (sources & SQ_BB(king_sq))) {
+    if (type != GEN_QUIET_CHECKS) {
+      _generate_castling_moves(moves);
+      return;
+    }
+    // A castling rook gives check too rarely to be worth masks, so play each one and look
+    MoveList castles;
+    _generate_castling_moves(castles);
+    for (uint32_t i = 0; i < castles.size(); i++) {
+      Undo undo;
+      doMove(castles[i], undo);
+      bool check = inCheck();
+      undoMove(castles[i], undo);
+      if (check) {
+        moves.push_back(castles[i]);
+      }
+    }
+  }
+}
+
+Bitboard Board::_blockers(int king_sq, int color, Bitboard occupied) {
+  Bitboard result = EMPTY_BB;
+  Bitboard snipers = (rook_attacks(king_sq, EMPTY_BB) & (_pieces[color][ROOK] | _pieces[color][QUEEN]))
+    | (bishop_attacks(king_sq, EMPTY_BB) & (_pieces[color][BISHOP] | _pieces[color][QUEEN]));
+  while (snipers) {
+    Bitboard blockers = BETWEEN[king_sq][pop_lsb(snipers)] & occupied;
+    if (popcount(blockers) == 1) {
+      result |= blockers;
+    }
+  }
+  return result;
+}
 
+// Castling moves are checked for legality here, because a king may not
+//  castle out of or through check
+void Board::_generate_castling_moves(MoveList &pseudo_moves) {
   // Add move to castle if allowed
-  if (_castling_rights[_color_to_play][KING_SIDE]) {  // King-side castle
+  if (_castling_rights & CASTLING_BIT(_color_to_play, KING_SIDE)) {  // King-side castle
     int king_pos = 4 * RIGHT + (_color_to_play == WHITE ? A1 : A8);
     int castle_pos = king_pos + 2 * RIGHT;
     if (_board[king_pos + RIGHT] == EMPTY &&
@@ -624,10 +1363,10 @@ std::vector<Move> Board::generateMoves() {
         !_attacked(king_pos, !_color_to_play) &&
         !_attacked(king_pos+RIGHT, !_color_to_play) &&
         !_attacked(castle_pos, !_color_to_play)) {
-      pseudo_moves.push_back((Move){king_pos, castle_pos, NO_PROMOTION});
+      pseudo_moves.push_back(Move(king_pos, castle_pos, NO_PROMOTION));
     }
   }
-  if (_castling_rights[_color_to_play][QUEEN_SIDE]) { // Queen-side castle
+  if (_castling_rights & CASTLING_BIT(_color_to_play, QUEEN_SIDE)) { // Queen-side castle
     int king_pos = 4 * RIGHT + (_color_to_play == WHITE ? A1 : A8);
     int castle_pos = king_pos + 2 * LEFT;
     if (_board[king_pos + LEFT] == EMPTY &&
@@ -636,25 +1375,9 @@ std::vector<Move> Board::generateMoves() {
         !_attacked(king_pos, !_color_to_play) &&
         !_attacked(king_pos+LEFT, !_color_to_play) &&
         !_attacked(castle_pos, !_color_to_play)) {
-      pseudo_moves.push_back((Move){king_pos, castle_pos, NO_PROMOTION});
-    }
-  }
-  // Filter out illegal pseudo-moves that would leave/put the player in check.
-  for (uint32_t i = 0; i < pseudo_moves.size(); i++) {
-    Board copy(*this);  // TODO: If we supported undo, it might be more efficient to use that instead of copying
-    copy.makeMove(pseudo_moves[i].src, pseudo_moves[i].dest, pseudo_moves[i].promotion);
-
-    // FIXME: Because our makeMove function has unclear behavior from illegal moves
-    //         we make sure that we actually moved a piece before calling it legal
-    if ((copy._board[pseudo_moves[i].src] != _board[pseudo_moves[i].src]) &&
-        ((_color_to_play == WHITE &&
-          !copy._attacked(copy._white_king_sq, BLACK)) ||
-         (_color_to_play == BLACK &&
-          !copy._attacked(copy._black_king_sq, WHITE)))) {
-      moves.push_back(pseudo_moves[i]);
+      pseudo_moves.push_back(Move(king_pos, castle_pos, NO_PROMOTION));
     }
   }
-  return moves;
 }
 
 // Print the in-bounds portion of the board
@@ -680,8 +1403,15 @@ std::ostream& operator<<(std::ostream &strm, const Board &b) {
 
 // Returns a string representing the Forsyth-Edwards Notation
 //  for this board
-std::string Board::to_fen() {
-  std::string fen = "";
+std::string Board::to_fen() const {
+  char fen[FEN_BUFFER_LEN];
+  size_t length = to_fen(fen, sizeof(fen));
+  return std::string(fen, length);
+}
+
+size_t Board::to_fen(char *buf, size_t size) const {
+  char fen[FEN_BUFFER_LEN];
+  char *out = fen;
   for (int rank = A8; rank >= A1; rank+=DOWN) {
     int empty_spaces = 0;
     for (int sq = rank; sq <= rank + 7 * RIGHT; sq+=RIGHT) {
@@ -689,53 +1419,72 @@ std::string Board::to_fen() {
         empty_spaces++;
       } else {
         if (empty_spaces > 0) {
-          fen += std::to_string(empty_spaces);
+          *out++ = (char)('0' + empty_spaces);
           empty_spaces = 0;
         }
-        fen += get_symbol(_board[sq]);
+        *out++ = PIECE_SYMBOLS[_board[sq] + KING];
       }
     }
     if (empty_spaces > 0) {
-      fen += std::to_string(empty_spaces);
-      empty_spaces = 0;
+      *out++ = (char)('0' + empty_spaces);
     }
 
     if (rank != A1) {
-      fen += "/";
+      *out++ = '/';
     }
   }
-  fen += (_color_to_play == WHITE ? " w " : " b ");
-  std::string castling = "";
-  castling += _castling_rights[WHITE][KING_SIDE] ? "K" : "";
-  castling += _castling_rights[WHITE][QUEEN_SIDE] ? "Q" : "";
-  castling += _castling_rights[BLACK][KING_SIDE] ? "k" : "";
-  castling += _castling_rights[BLACK][QUEEN_SIDE] ? "q" : "";
-  fen += castling.size() == 0 ? "-" : castling;
-  fen += _en_passant_square == NO_SQUARE ? " - "
-    : " " + sq_name(_en_passant_square) + " ";
-  fen += " " + std::to_string(_half_moves);
-  fen += " " + std::to_string(_full_moves);
-  return fen;
+  *out++ = ' ';
+  *out++ = _color_to_play == WHITE ? 'w' : 'b';
+  *out++ = ' ';
+  if (_castling_rights == NO_CASTLING) {
+    *out++ = '-';
+  }
+  if (_castling_rights & CASTLING_BIT(WHITE, KING_SIDE)) *out++ = 'K';
+  if (_castling_rights & CASTLING_BIT(WHITE, QUEEN_SIDE)) *out++ = 'Q';
+  if (_castling_rights & CASTLING_BIT(BLACK, KING_SIDE)) *out++ = 'k';
+  if (_castling_rights & CASTLING_BIT(BLACK, QUEEN_SIDE)) *out++ = 'q';
+  *out++ = ' ';
+  if (_en_passant_square == NO_SQUARE) {
+    *out++ = '-';
+  } else {
+    *out++ = (char)('a' + (_en_passant_square - A1) % UP);
+    *out++ = (char)('1' + (_en_passant_square - A1) / UP);
+  }
+  // Two spaces before the counters, as INITIAL_FEN has
+  *out++ = ' ';
+  *out++ = ' ';
+  out = std::to_chars(out, out + 11, _half_moves).ptr;  // Enough for any int
+  *out++ = ' ';
+  out = std::to_chars(out, out + 11, _full_moves).ptr;
+
+  size_t length = out - fen;
+  if (length + 1 > size) {
+    return 0;
+  }
+  memcpy(buf, fen, length);
+  buf[length] = '\0';
+  return length;
 }
 
 // Count the number of possible moves generated by this board
 // for each move up to certain depth
 long Board::perft(int depth, bool printSubcounts) {
-  std::vector<Move> moves;
+  MoveList moves;
   long count = 0;
   if (depth == 0) {
-    return count;
+    return 1;  // The position itself is the only leaf
   }
 
-  moves = this->generateMoves();
+  generateMoves(moves);
   if (depth == 1) {
     return moves.size();
   }
 
   for (uint32_t i = 0; i < moves.size(); i++) {
-    Board copy(*this);  // TODO: What is the performance impact of copying?
-    copy.makeMove(moves[i].src, moves[i].dest, moves[i].promotion);
-    int subCount = copy.perft(depth - 1);
+    Undo undo;
+    doMove(moves[i], undo);
+    long subCount = perft(depth - 1);
+    undoMove(moves[i], undo);
     if (printSubcounts) {
       std::cout << sq_name(moves[i].src);
       std::cout << sq_name(moves[i].dest);
@@ -746,239 +1495,145 @@ long Board::perft(int depth, bool printSubcounts) {
   return count;
 }
 
-// Performs perft on the current board upto depth,
-// but divides up the count by each of the board possible from the current 
-void Board::perftDivide(int depth) {
-  std::vector<Move> moves;
-  int count = 0;
-  if (depth == 0) {
-    std::cout << "Done" << std::endl;
+// Perft which caches the count below each position in table, so positions
+//  reached again through a different move order are not searched twice
+long Board::perft(int depth, PerftTable &table) {
+  if (depth <= 1) {
+    return perft(depth);
   }
 
-  moves = this->generateMoves();
+  uint64_t cached;
+  if (table.probe(_hash, depth, cached)) {
+    return cached;
+  }
 
+  MoveList moves;
+  generateMoves(moves);
+  long count = 0;
   for (uint32_t i = 0; i < moves.size(); i++) {
-    // TODO: Print the move name
-    std::cout << sq_name(moves[i].src) << sq_name(moves[i].dest) << get_symbol(moves[i].promotion);
-    // FIXME: Move generation and perft relying on copying the board
-    // is much too slow
-    Board copy(*this);
-    copy.makeMove(moves[i].src, moves[i].dest, moves[i].promotion);
-    int move_count = copy.perft(depth - 1);
-    count += move_count;
-    //TODO: Print the move along with its perft result
-    std::cout << " " << move_count << std::endl;
+    Undo undo;
+    doMove(moves[i], undo);
+    count += perft(depth - 1, table);
+    undoMove(moves[i], undo);
   }
-  std::cout << "Total: " << count << std::endl;
+  table.store(_hash, depth, count);
+  return count;
 }
 
-char *Board::_generate_valid_attacks() {
-  // TODO: Replace this with a smart pointer so it is correctly freed
-  char *valid_attacks = new char[_VALID_ATTACKS_LEN]();
-  for (int i = 0; i < _VALID_ATTACKS_LEN; i++) {
-    int move_delta = i - _VALID_ATTACKS_OFFSET;
-    if (
-        move_delta == 0) {
-      // Out of bounds
-      continue;
-    }
-    // Pick up and move pieces
-    if (std::find(std::begin(KNIGHT_MOVES),
-          std::end(KNIGHT_MOVES),
-          move_delta) != std::end(KNIGHT_MOVES)) {
-      valid_attacks[i] |= (1 << KNIGHT_SHIFT);
-    }
-
-    if (std::find(std::begin(KING_MOVES),
-          std::end(KING_MOVES),
-          move_delta) != std::end(KING_MOVES)) {
-      valid_attacks[i] |= (1 << KING_SHIFT);
-    }
-
-    if (std::find(std::begin(WHITE_PAWN_MOVES),
-          std::end(WHITE_PAWN_MOVES),
-          move_delta) != std::end(WHITE_PAWN_MOVES)) {
-      valid_attacks[i] |= (1 << WHITE_PAWN_SHIFT);
-    }
-
-    if (std::find(std::begin(BLACK_PAWN_MOVES),
-          std::end(BLACK_PAWN_MOVES),
-          move_delta) != std::end(BLACK_PAWN_MOVES)) {
-      valid_attacks[i] |= (1 << BLACK_PAWN_SHIFT);
-    }
-
-    // Sliding pieces
-    // Movement within a file
-    if (move_delta % (UP) == 0) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << ROOK_SHIFT);
-    }
-    if (move_delta % (DOWN) == 0) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << ROOK_SHIFT);
-    }
-    // Movement within a rank
-    if (move_delta <=7 && move_delta >= -7) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << ROOK_SHIFT);
+// Perft with the work split across the threads of pool. The subtree under each
+//  root move's replies is its own task, which gives enough tasks to keep many
+//  threads busy. If subcounts is given it is filled with the count under each
+//  move of generateMoves(), in the same order.
+long Board::perftParallel(int depth, ThreadPool &pool, PerftTable *table, std::vector<long> *subcounts) {
+  if (depth == 0) {
+    if (subcounts) {
+      subcounts->clear();
     }
+    return 1;
+  }
+  MoveList moves;
+  generateMoves(moves);
+  // Each task writes only its own slot, so no locking is needed and
+  //  the totals are added up in the same order every time
+  std::vector<std::vector<long> > counts(moves.size());
 
-    // Movement along diagonals
-    if (move_delta % (UP+RIGHT) == 0) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << BISHOP_SHIFT);
-    }
-    if (move_delta % (UP+LEFT) == 0) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << BISHOP_SHIFT);
-    }
-    if (move_delta % (DOWN+RIGHT) == 0) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << BISHOP_SHIFT);
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    Board child(*this);
+    Undo undo;
+    child.doMove(moves[i], undo);
+    if (depth < 3) {
+      counts[i].resize(1);
+      long *slot = &counts[i][0];
+      pool.submit([child, depth, table, slot]() mutable {
+        *slot = table ? child.perft(depth - 1, *table) : child.perft(depth - 1);
+      });
+      continue;
     }
-    if (move_delta % (DOWN+LEFT) == 0) {
-      valid_attacks[i] |= (1 << QUEEN_SHIFT);
-      valid_attacks[i] |= (1 << BISHOP_SHIFT);
+    MoveList replies;
+    child.generateMoves(replies);
+    counts[i].resize(replies.size());
+    for (uint32_t j = 0; j < replies.size(); j++) {
+      Board grandchild(child);
+      grandchild.doMove(replies[j], undo);
+      long *slot = &counts[i][j];
+      pool.submit([grandchild, depth, table, slot]() mutable {
+        *slot = table ? grandchild.perft(depth - 2, *table) : grandchild.perft(depth - 2);
+      });
     }
   }
+  pool.wait();
 
-  return valid_attacks;
-}
-
-// Debug function to print the VALID_ATTACKS array
-void Board::_print_valid_attacks(int bit_shift) {
-  int piece_num = bit_shift;
-  // Map our bit shifts onto our piece nums, so we can use get_symbol
-  if (piece_num == 0) {
-    piece_num++;
+  long count = 0;
+  if (subcounts) {
+    subcounts->assign(moves.size(), 0);
   }
-  for (int up = 7; up >= -7; up--) {
-    for(int right = -7; right <= 7; right ++) {
-      char valid_attackers = _VALID_ATTACKS[(up * UP) + right * (RIGHT) + _VALID_ATTACKS_OFFSET];
-      if (valid_attackers & (1 << bit_shift)) {
-        std::cout << get_symbol(piece_num) << " ";
-      } else {
-        std::cout << "_ ";
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    for (uint32_t j = 0; j < counts[i].size(); j++) {
+      count += counts[i][j];
+      if (subcounts) {
+        (*subcounts)[i] += counts[i][j];
       }
     }
-    std::cout << "\n";
   }
-  std::cout << "\n";
+  return count;
 }
 
-// Returns true if a piece of type piece on square src can
-//  attack dest if it can move
-bool Board::_attacks(int piece, int src, int dest) {
-  // Convert from piece values to bit-shifted values for the attacks array
-  int bit_shift = piece;
-  if (bit_shift == 1) {
-    bit_shift = 0;
+// Performs perft on the current board upto depth,
+// but divides up the count by each of the board possible from the current 
+void Board::perftDivide(int depth, PerftTable *table) {
+  MoveList moves;
+  long count = 0;
+  if (depth == 0) {
+    std::cout << "Done" << std::endl;
   }
-  if (bit_shift < 0) {
-    bit_shift *= -1;
+
+  generateMoves(moves);
+
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    // TODO: Print the move name
+    std::cout << sq_name(moves[i].src) << sq_name(moves[i].dest) << get_symbol(moves[i].promotion);
+    Undo undo;
+    doMove(moves[i], undo);
+    long move_count = table ? perft(depth - 1, *table) : perft(depth - 1);
+    undoMove(moves[i], undo);
+    count += move_count;
+    //TODO: Print the move along with its perft result
+    std::cout << " " << move_count << std::endl;
   }
+  std::cout << "Total: " << count << std::endl;
+}
 
-  // Get vector displacement between source and dest
-  int delta = dest - src;
-  // Find the set of pieces that attack this square (?)
-  char mask = _VALID_ATTACKS[delta + _VALID_ATTACKS_OFFSET];
-  if ((mask & (1 << bit_shift)) == 0) {
-    return false;
+// perftDivide, running on the threads of pool. Prints the same lines in the same order
+void Board::perftDivide(int depth, ThreadPool &pool, PerftTable *table) {
+  if (depth == 0) {
+    std::cout << "Done" << std::endl;
+    return;
   }
-  // If it is a sliding piece, check that it is not blocked
-  if (bit_shift == ROOK_SHIFT || bit_shift == QUEEN_SHIFT ||
-      bit_shift == BISHOP) {
-    int dir;
-    if (delta > 0) {
-      if (delta < 8)
-        dir = RIGHT;
-      else if (delta % UP == 0) {
-        dir = UP;
-      } else if (delta % (UP+LEFT) == 0) {
-        dir = UP+LEFT;
-      } else if (delta % (UP+RIGHT) == 0) {
-        dir = UP+RIGHT;
-      }
-    } else if (delta < 0) {
-      if (delta > -8) {
-        dir = LEFT;
-      } else if (delta % DOWN == 0) {
-        dir = DOWN;
-      } else if (delta % (DOWN+LEFT) == 0) {
-        dir = DOWN+LEFT;
-      } else if (delta % (DOWN+RIGHT) == 0) {
-        dir = DOWN+RIGHT;
-      }
-    }
-    for (int i = src + dir; i != dest; i += dir) {
-      // FIXME: Is there an off by one error here?
-      if (_board[i] != EMPTY) {
-        return false;
-      }
-    }
+  MoveList moves;
+  generateMoves(moves);
+  std::vector<long> subcounts;
+  long count = perftParallel(depth, pool, table, &subcounts);
+  for (uint32_t i = 0; i < moves.size(); i++) {
+    std::cout << sq_name(moves[i].src) << sq_name(moves[i].dest) << get_symbol(moves[i].promotion);
+    std::cout << " " << subcounts[i] << std::endl;
   }
+  std::cout << "Total: " << count << std::endl;
+}
 
-  // For pawns, check that double push is allowed, it isn't blocked,
-  //  and that any diagonal moves are for captures only
-  if (bit_shift == WHITE_PAWN_SHIFT) {
-    if (delta == 2 * UP) {  // Double push
-      if (_board[src + UP] != EMPTY || _board[src + 2*UP] != EMPTY) {  // Check if blocked
-        return false;
-      }
-      if (src > H1 + UP) { // Check if pawn is beyond 2nd rank
-        return false;
-      }
-    }
-    if (delta == UP) {
-      if (_board[src + UP] != EMPTY) {  // Check if blocked
-        return false;
-      }
-    }
-    if (delta % UP != 0) {  // Pawn Cpature
-      if (_board[dest] == EMPTY) {
-        if (dest != _en_passant_square) {
-          return false;
-        }
-      }
-    }
-  } else if (bit_shift == BLACK_PAWN_SHIFT) {
-    if (delta == 2 * DOWN) { // Double push
-      if (_board[src + DOWN] != EMPTY || _board[src + 2*DOWN] != EMPTY) { // Check if blocked
-        return false;
-      }
-      if (src < A8 + DOWN) {  // Check pawn is beyond 7th rank
-        return false;
-      }
-    }
-    if (delta == DOWN) {
-      if (_board[src + DOWN] != EMPTY) {  // Check if blocked
-        return false;
-      }
-    }
-    if (delta % DOWN != 0) {  // pawn capture
-      if (_board[dest] == EMPTY) {
-        if (dest != _en_passant_square) {
-          return false;
-        }
-      }
-    }
-  }
-  return true;
+// Returns the set of pieces of the given color attacking sq (a 0..63 square),
+//  with occupied as the pieces that may block sliders. Rather than asking every
+//  piece whether it reaches sq, this looks outward from sq: a knight attacks sq
+//  exactly when a knight on sq would attack it, and likewise for the others.
+Bitboard Board::_attackers_to(int sq, int color, Bitboard occupied) {
+  const Bitboard *pieces = _pieces[color];
+  return (PAWN_ATTACKS[!color][sq] & pieces[PAWN])
+    | (KNIGHT_ATTACKS[sq] & pieces[KNIGHT])
+    | (KING_ATTACKS[sq] & pieces[KING])
+    | (bishop_attacks(sq, occupied) & (pieces[BISHOP] | pieces[QUEEN]))
+    | (rook_attacks(sq, occupied) & (pieces[ROOK] | pieces[QUEEN]));
 }
 
 // Returns whether the given square is attacked by color
 bool Board::_attacked(int dest_sq, int color) {
-  for (int src_sq = A1; src_sq <= H8; src_sq++) {
-    if (_board[src_sq] == OUTOFBOUNDS || _board[src_sq] == EMPTY) {
-      continue;
-    }
-    if ((_board[src_sq] < 0 && color == WHITE) ||
-        (_board[src_sq] > 0 && color == BLACK)) {
-      continue;
-    }
-    if (_attacks(_board[src_sq], src_sq, dest_sq)) {
-      return true;
-    }
-  }
-  return false;
+  return _attackers_to(SQ64(dest_sq), color, _occupied[WHITE] | _occupied[BLACK]) != EMPTY_BB;
 }
@@ -5,7 +5,10 @@
 #include <ostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <algorithm>
+#include <stdint.h>
+#include "bitboard.hpp"
 
 // To help determine how the One-Dimensional Array maps to
 // the Two-Dimensional Chessboard
@@ -21,6 +24,10 @@
 #define RIGHT 1
 #define LEFT -1
 
+// Converting between the 16x16 board array and the 0..63 bitboard squares
+#define SQ64(sq) ((((sq) - A1) / UP) * 8 + ((sq) - A1) % UP)
+#define SQ256(sq) (A1 + ((sq) / 8) * UP + ((sq) % 8) * RIGHT)
+
 // Possible piece types in the board array
 #define EMPTY  0
 #define PAWN 1
@@ -40,107 +47,337 @@
 #define KING_SIDE 0
 #define QUEEN_SIDE 1
 
+// Board._castling_rights packs the four castling moves into the low bits of a byte
+#define NO_CASTLING 0
+#define CASTLING_BIT(color, side) (1 << ((color) * 2 + (side)))
+
 #define INITIAL_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -  0 1"
 
 // Define arrays for each piece's moves
 // Compositions of UP,DOWN,etc. work because no number of (legal) RIGHT moves can add up to an UP move
 //  (The max is 8 Right moves, but a single up is 10 spaces in the board array)
-const std::vector<int> WHITE_PAWN_MOVES = {UP, UP+UP, UP+RIGHT, UP+LEFT};
-const std::vector<int> BLACK_PAWN_MOVES = {DOWN, DOWN+DOWN, DOWN+LEFT, DOWN+RIGHT};
-const std::vector<int>  KNIGHT_MOVES = {UP+UP+RIGHT, UP+UP+LEFT, RIGHT+RIGHT+DOWN,
+constexpr int WHITE_PAWN_MOVES[] = {UP, UP+UP, UP+RIGHT, UP+LEFT};
+constexpr int BLACK_PAWN_MOVES[] = {DOWN, DOWN+DOWN, DOWN+LEFT, DOWN+RIGHT};
+constexpr int KNIGHT_MOVES[] = {UP+UP+RIGHT, UP+UP+LEFT, RIGHT+RIGHT+DOWN,
             RIGHT+RIGHT+UP, DOWN+DOWN+RIGHT, DOWN+DOWN+LEFT,
             LEFT+LEFT+DOWN, LEFT+LEFT+UP};
-const std::vector<int>  KING_MOVES = {UP, RIGHT, DOWN, LEFT, UP+RIGHT, UP+LEFT,
+constexpr int KING_MOVES[] = {UP, RIGHT, DOWN, LEFT, UP+RIGHT, UP+LEFT,
             DOWN+RIGHT, DOWN+LEFT};
 
-const std::vector<int>  QUEEN_MOVES = {UP, RIGHT, DOWN, LEFT, UP+RIGHT, UP+LEFT,
+constexpr int QUEEN_MOVES[] = {UP, RIGHT, DOWN, LEFT, UP+RIGHT, UP+LEFT,
             DOWN+RIGHT, DOWN+LEFT};
-const std::vector<int>  BISHOP_MOVES = {UP+RIGHT, UP+LEFT, DOWN+RIGHT, DOWN+LEFT};
-const std::vector<int>  ROOK_MOVES = {UP, RIGHT, DOWN, LEFT};
-
-// Bit Shifts for the _VALID_ATTACKS bit-mask board
-#define WHITE_PAWN_SHIFT 0
-#define BLACK_PAWN_SHIFT 1
-#define KNIGHT_SHIFT 2
-#define BISHOP_SHIFT 3
-#define ROOK_SHIFT 4
-#define QUEEN_SHIFT 5
-#define KING_SHIFT 6
-
-#define MAX_MOVE (H8-A1)
-#define _VALID_ATTACKS_LEN ((MAX_MOVE * 2) + 1)
-#define _VALID_ATTACKS_OFFSET MAX_MOVE
+constexpr int BISHOP_MOVES[] = {UP+RIGHT, UP+LEFT, DOWN+RIGHT, DOWN+LEFT};
+constexpr int ROOK_MOVES[] = {UP, RIGHT, DOWN, LEFT};
+
+// The two ways the Board can generate moves. Both produce the same moves,
+//  the mailbox generator is kept as a simple reference to check against.
+enum MoveGenerator {
+  MAILBOX_GENERATOR,
+  BITBOARD_GENERATOR
+};
+
+// Which moves to generate. Captures includes every promotion, and
+//  quiets are all the other moves, so the two together make up GEN_ALL
+enum GenType {
+  GEN_ALL,
+  GEN_CAPTURES,
+  GEN_QUIETS,
+  GEN_EVASIONS,  // Every move out of check, or none when not in check
+  GEN_QUIET_CHECKS  // The quiet moves that give check, directly or by discovery
+};
 
+// A move packed into 3 bytes: the board array squares it moves between (every
+//  board square fits a byte), and the signed promotion piece or NO_PROMOTION
 struct Move {
-  int src;
-  int dest;
-  int promotion;
+  uint8_t src;
+  uint8_t dest;
+  int8_t promotion;
+
+  Move() {}
+  Move(int src, int dest, int promotion) : src(src), dest(dest), promotion(promotion) {}
 };
 
+// Square 0 is outside the board, so no real move can equal this
+#define NO_MOVE Move(0, 0, NO_PROMOTION)
+
+inline bool operator==(const Move &a, const Move &b) {
+  return a.src == b.src && a.dest == b.dest && a.promotion == b.promotion;
+}
+
+inline bool operator!=(const Move &a, const Move &b) {
+  return !(a == b);
+}
+
+// Rough piece values, indexed by piece type, for exchanges and ordering
+//  captures. The evaluation has its own, finer values
+const int PIECE_VALUES[KING + 1] = {0, 100, 320, 330, 500, 900, 20000};
+
+// Fixed-capacity list of moves, kept on the stack so generating moves never
+//  allocates. No position has more than 218 legal moves, and even the mailbox
+//  generator's pseudo-legal moves stay well under MAX_MOVES.
+#define MAX_MOVES 256
+
+class MoveList {
+  public:
+    MoveList() : _size(0) {}
+
+    void push_back(const Move &move) { _moves[_size++] = move; }
+    void clear() { _size = 0; }
+    uint32_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    Move &operator[](uint32_t i) { return _moves[i]; }
+    const Move &operator[](uint32_t i) const { return _moves[i]; }
+    Move *begin() { return _moves; }
+    Move *end() { return _moves + _size; }
+    const Move *begin() const { return _moves; }
+    const Move *end() const { return _moves + _size; }
+
+  private:
+    Move _moves[MAX_MOVES];
+    uint32_t _size;
+};
+
+// The state a move destroys, which is needed to take it back again with undoMove.
+//  Everything else (e.g. which piece moved, where the rook goes when castling)
+//  can be worked out from the Move itself.
+struct Undo {
+  int captured;  // Piece that was on the destination square (EMPTY for en passant)
+  int en_passant_square;
+  uint8_t castling_rights;
+  int half_moves;
+  int white_king_sq;
+  int black_king_sq;
+  uint64_t hash;
+};
+
+class PerftTable;
+class ThreadPool;
+
 // Useful functions for converting between internal and external representation
 int get_pos_rankfile(std::string pos);
 int symbol_to_piece(char sym);
 std::string get_symbol(int piece_num);
 std::string sq_name(int sq);
+// Long algebraic notation as UCI uses it, e.g. "e2e4", "e7e8q", or "0000" for NO_MOVE
+std::string move_to_uci(const Move &move);
+
+// How much Board::parseUci, parseSan and the replay functions check each move
+enum ReplayMode {
+  REPLAY_TRUSTED,  // The moves are known to be legal (e.g. sent by a GUI, or from a game database), so only the text is checked
+  REPLAY_VALIDATE  // Every move must be legal, and a SAN move must match exactly one legal move
+};
+
+// Result of parsing a FEN with Board::setFen
+enum FenError {
+  FEN_OK,
+  FEN_BAD_PLACEMENT,  // Not 8 ranks of 8 files, an unknown piece letter, or more pieces than a game can have
+  FEN_BAD_KINGS,  // Each side needs exactly one king
+  FEN_BAD_COLOR,
+  FEN_BAD_CASTLING,
+  FEN_BAD_EN_PASSANT,
+  FEN_BAD_CLOCKS,
+  FEN_BAD_CHECK  // The side that just moved is still in check
+};
+
+// Result of trying to play a move with Board::tryMove
+enum MoveResult {
+  MOVE_OK,
+  MOVE_NO_PIECE,  // No piece of the side to move on the source square
+  MOVE_BAD_DESTINATION,  // The piece cannot move there
+  MOVE_BAD_PROMOTION,  // A pawn reaching the last rank needs a knight, bishop, rook or queen, and no other move takes one
+  MOVE_BAD_CASTLING,  // The right to castle is gone, a piece is in the way, or the king is in or passes through check
+  MOVE_LEAVES_KING_IN_CHECK
+};
+
+// Positions remembered for finding repetitions. A power of two, and longer
+//  than the 100 plies after which the fifty-move rule draws anyway
+#define KEY_HISTORY_LEN 128
+
+// Buffer size that always holds a FEN from Board::to_fen, including the terminating NUL
+#define FEN_BUFFER_LEN 128
+
+class KeyHistory;
 
 // TODO: Standardize on camelCase or under_scores
 class Board {
   public:
-    // Constructors/Destructors
+    // Constructors
+    // Boards hold no pointers, so the default copy is a plain memcpy
     Board() : Board(INITIAL_FEN) {};
-    Board(const Board& other);
-    Board(std::string fen);
-    Board& operator=(Board other);
-    ~Board();
+    // The FEN must be valid. Use setFen to parse FENs that may not be
+    Board(std::string_view fen);
+
+    // Sets up the position in fen, without allocating. The half and full move
+    //  counters may be left off, and default to 0 and 1. On an error the board
+    //  is left in no particular position, and must not be used until a FEN parses.
+    FenError setFen(std::string_view fen);
  
-    // Moves the piece from src to dest if it is a valid move on this board.
-    //  if the pawn can promote, then the chosen piece is also given
-    void makeMove(int src, int dest);
-    void makeMove(int src, int dest, int promotion);
-    // TODO: Add an "undoMove", which would be more efficient than creating a whole new board.
+    // Moves the piece from src to dest if it is a legal move on this board,
+    //  else leaves the board alone and says why not. A pawn reaching the
+    //  last rank must be given the piece it promotes to (of either color)
+    MoveResult tryMove(int src, int dest, int promotion = NO_PROMOTION);
+
+    // Plays a move without checking that it is legal, so it should come from
+    //  generateMoves(). Fills undo with what is needed to take the move back.
+    void doMove(const Move &move, Undo &undo);
+    // Takes back a move played with doMove(move, undo), restoring the board
+    //  to exactly the state it was in beforehand
+    void undoMove(const Move &move, const Undo &undo);
 
     // Given the current state of the board, generate a vector of Moves
-    std::vector<Move> generateMoves();
+    MoveList generateMoves(GenType type = GEN_ALL);
+    // The same, filling moves (which is cleared first)
+    void generateMoves(MoveList &moves, GenType type = GEN_ALL);
+    // Whether move is one of generateMoves()
+    bool isLegal(const Move &move);
+    // Whether move is a GEN_CAPTURES move, rather than a quiet one
+    bool isCaptureOrPromotion(const Move &move) const;
+    // Static exchange evaluation: the material move wins (in PIECE_VALUES) if both
+    //  sides go on recapturing on its destination with their least valuable
+    //  piece, each stopping once that would lose more
+    int see(const Move &move);
+    // Standard algebraic notation for a legal move, e.g. "Nbd7", "exd6", "e8=Q+" or "O-O"
+    std::string toSan(const Move &move);
+    // Reads a move of the side to move in long algebraic notation, e.g. "e2e4" or
+    //  "e7e8q". Returns NO_MOVE if the text is not one, or when validating, if it is illegal
+    Move parseUci(std::string_view text, ReplayMode mode = REPLAY_VALIDATE);
+    // Reads a move in standard algebraic notation, e.g. "Nbd7", "exd8=Q+" or "O-O".
+    //  Only the moves of the pieces the text could mean are generated to find it
+    Move parseSan(std::string_view text, ReplayMode mode = REPLAY_VALIDATE);
+    // Play a list of UCI moves separated by spaces, or the mainline of PGN movetext
+    //  (move numbers, comments, variations, NAGs and the result are skipped).
+    //  Both stop at the first move that does not parse and return false, leaving
+    //  the board after the moves before it. played is set to the number of moves
+    //  played, and the hash after each one is pushed onto history
+    bool replayUci(std::string_view moves, ReplayMode mode = REPLAY_VALIDATE, int *played = NULL,
+                   KeyHistory *history = NULL);
+    bool replaySan(std::string_view movetext, ReplayMode mode = REPLAY_VALIDATE, int *played = NULL,
+                   KeyHistory *history = NULL);
+    // Choose which generator generateMoves() uses (BITBOARD_GENERATOR by default)
+    void setGenerator(MoveGenerator generator) { _generator = generator; }
+
+    // Read-only views of the position, for the search and evaluation
+    int colorToPlay() const { return _color_to_play; }
+    int pieceAt(int sq) const { return _board[sq]; }
+    uint8_t castlingRights() const { return _castling_rights; }
+    int enPassantSquare() const { return _en_passant_square; }
+    int halfMoves() const { return _half_moves; }
+    Bitboard pieces(int color, int piece) const { return _pieces[color][piece]; }
+    // Running evaluation sums from white's point of view (see eval.hpp)
+    int mgScore() const { return _mg_score; }
+    int egScore() const { return _eg_score; }
+    int phase() const { return _phase; }
+    // Whether the side to move is in check
+    bool inCheck();
+    // Whether the game is drawn by the fifty-move rule, insufficient material,
+    //  or the position having occurred repetitions times before in history
+    //  (threefold repetition by default). Stalemate is left to the caller,
+    //  which has to generate the moves anyway
+    bool isDraw(const KeyHistory &history, int repetitions = 2);
+
+    // 64-bit Zobrist key identifying the position, kept up to date by doMove.
+    //  Building with -DHASH_DEBUG checks it against computeHash() after every move
+    uint64_t hash() const { return _hash; }
+    uint64_t computeHash();
 
     friend std::ostream& operator<<(std::ostream &strm, const Board &b);
-    std::string to_fen();
+    std::string to_fen() const;
+    // Writes the FEN and a terminating NUL into buf, without allocating. Returns
+    //  the length of the FEN, or 0 if it does not fit (FEN_BUFFER_LEN always fits)
+    size_t to_fen(char *buf, size_t size) const;
 
     // Perft counts the number of leaves of the search tree for a given depth
     // This is useful in debugging to compare this value with that of a known
     // correct chess engine
     long perft(int depth, bool printSubcounts = false);
-    void perftDivide(int depth);
+    // The same count, but reusing subtree counts cached in table
+    long perft(int depth, PerftTable &table);
+    void perftDivide(int depth, PerftTable *table = NULL);
+    // Multi-threaded versions, splitting the tree into tasks run on pool.
+    //  subcounts receives the count under each move of generateMoves()
+    long perftParallel(int depth, ThreadPool &pool, PerftTable *table = NULL,
+                       std::vector<long> *subcounts = NULL);
+    void perftDivide(int depth, ThreadPool &pool, PerftTable *table = NULL);
     
   private:
-    int *_board;
+    int8_t _board[BOARD_ARR_LEN];
     int _half_moves;  // Number of moves (black or white) since the last pawn push or piece capture
     int _full_moves;  // Number of times black has moved
     int _color_to_play;
     int _en_passant_square;  // If a pawn moved 2 spaces last turn, this is the en passant square
-    bool **_castling_rights;  // Boolean array storing which castling moves are still available
+    uint8_t _castling_rights;  // Bit-mask of CASTLING_BITs for the castling moves still available
 
     // Cache the location of the white/black kings because we have to
     //  check if these pieces are in check often
     int _white_king_sq;
     int _black_king_sq;
 
-    const static char *_VALID_ATTACKS;  // Bitboard caching valid piece movements
+    // The same position as _board, as sets of squares for each color and piece type
+    Bitboard _pieces[2][KING + 1];  // Indexed by color, then by piece type (PAWN..KING)
+    Bitboard _occupied[2];  // Every square holding a piece of each color
+
+    MoveGenerator _generator;
+
+    uint64_t _hash;
 
-    // Helper function which initializes _VALID_ATTACKS
-    // based on how pieces can move
-    char *_generate_valid_attacks();
+    // Material and piece-square sums, updated as pieces are put and removed
+    int _mg_score;
+    int _eg_score;
+    int _phase;
 
-    // Method to aid in debugging by printing the _VALID_ATTACKS
-    //  bitboard for a specific piece
-    void _print_valid_attacks(int bit_shift);
+    // Keep the board array and bitboards in step when adding/removing a piece
+    void _put_piece(int sq, int piece);
+    void _remove_piece(int sq);
 
-    // Helper function returning whether the piece on src attacks the square dest
-    bool _attacks(int piece, int src, int dest);
+    // Zobrist key for the en passant square, or 0 if it can't be captured on
+    uint64_t _en_passant_key();
+    // Neither side has the pieces left to mate, however badly the other plays
+    bool _insufficient_material() const;
+
+    // Add moves for the side to move, using each representation. The mailbox
+    //  moves are pseudo-legal, and have to be played to test for check. The
+    //  bitboard moves are already legal, using the pins and checks on the king
+    void _generate_mailbox_moves(MoveList &moves);
+    void _generate_bitboard_moves(MoveList &moves, GenType type, Bitboard sources);
+    // Pieces of either color that are alone between king_sq and a slider of color
+    Bitboard _blockers(int king_sq, int color, Bitboard occupied);
+    // Add the castling moves that are available. These are already fully legal
+    void _generate_castling_moves(MoveList &moves);
+    // The legal move from one of sources to dest with the given promotion piece
+    //  type, or NO_MOVE. When validating, a second match also gives NO_MOVE
+    Move _find_move(Bitboard sources, int dest, int promotion, ReplayMode mode);
+
+    // Helper function returning the pieces of color that attack the bitboard
+    //  square sq, treating the pieces in occupied as blockers
+    Bitboard _attackers_to(int sq, int color, Bitboard occupied);
     // Helper function returning whether the given color has a piece attacking
     //  the given square
     bool _attacked(int dest_sq, int color);
 
 };
 
+// Hashes of the positions of a game, for finding repetitions. Kept outside
+//  Board so that boards stay small to copy: whoever plays the moves, a game
+//  or a search, pushes the hash after each one and pops it on taking it back
+class KeyHistory {
+  public:
+    KeyHistory() : _ply(0) { _keys[0] = 0; }
+
+    // Starts over at the position of board, as the earlier ones are unknown
+    void reset(const Board &board) { _ply = 0; _keys[0] = board.hash(); }
+    void push(uint64_t key) { _keys[++_ply & (KEY_HISTORY_LEN - 1)] = key; }
+    void pop() { _ply--; }
+    // How many times the position of board, which is the last one pushed, has
+    //  occurred before. Found by comparing hashes, so castling and en passant
+    //  rights count as they should
+    int repetitions(const Board &board) const;
+
+  private:
+    // _keys[_ply % KEY_HISTORY_LEN] is the current position
+    uint64_t _keys[KEY_HISTORY_LEN];
+    int _ply;
+};
+
 
 #endif // _BOARD_HPP_
@@ -0,0 +1,208 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// book.cc
+// Memory-mapped Polyglot opening book
+
+#include "book.hpp"
+#include "bitboard.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ENTRY_SIZE 16
+#define CASTLING_KEYS 768
+#define EN_PASSANT_KEYS 772
+#define WHITE_TO_PLAY_KEY 780
+
+// The Random64 table from the Polyglot sources, as 781 comma separated literals
+static const uint64_t POLYGLOT_RANDOM[POLYGLOT_RANDOM_LEN] = {
+#include "polyglot_random.inc"
+};
+
+// Positions from the Polyglot documentation, by the moves from the start, with
+//  their published keys. Between them they lose castling rights and have en
+//  passant squares that do and do not count
+static const struct {
+  const char *moves;
+  uint64_t key;
+} PUBLISHED_KEYS[] = {
+  {"", POLYGLOT_START_KEY},
+  {"e2e4", 0x823C9B50FD114196ULL},
+  {"e2e4 d7d5", 0x0756B94461C50FB0ULL},
+  {"e2e4 d7d5 e4e5", 0x662FAFB965DB29D4ULL},
+  {"e2e4 d7d5 e4e5 f7f5", 0x22A48B5A8E47FF78ULL},
+  {"e2e4 d7d5 e4e5 f7f5 e1e2", 0x652A607CA3F242C1ULL},
+  {"e2e4 d7d5 e4e5 f7f5 e1e2 e8f7", 0x00FDD303C946BDD9ULL},
+  {"a2a4 b7b5 h2h4 b5b4 c2c4", 0x3C8123EA7B067637ULL},
+  {"a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a3", 0x5C3F9B829B279560ULL},
+};
+
+static uint64_t read_big_endian(const unsigned char *bytes, int size) {
+  uint64_t value = 0;
+  for (int i = 0; i < size; i++) {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+// Polyglot orders the pieces black pawn, white pawn, black knight, ..., white king,
+//  and squares a1, b1, ..., h8 like the bitboards. En passant only counts when a
+//  pawn of the side to move stands next to the pawn that just moved
+uint64_t polyglot_key(const Board &board) {
+  uint64_t key = 0;
+  for (int color = WHITE; color <= BLACK; color++) {
+    for (int piece = PAWN; piece <= KING; piece++) {
+      int kind = 2 * (piece - PAWN) + (color == WHITE ? 1 : 0);
+      Bitboard b = board.pieces(color, piece);
+      while (b) {
+        key ^= POLYGLOT_RANDOM[64 * kind + pop_lsb(b)];
+      }
+    }
+  }
+
+  uint8_t rights = board.castlingRights();
+  key ^= rights & CASTLING_BIT(WHITE, KING_SIDE) ? POLYGLOT_RANDOM[CASTLING_KEYS] : 0;
+  key ^= rights & CASTLING_BIT(WHITE, QUEEN_SIDE) ? POLYGLOT_RANDOM[CASTLING_KEYS + 1] : 0;
+  key ^= rights & CASTLING_BIT(BLACK, KING_SIDE) ? POLYGLOT_RANDOM[CASTLING_KEYS + 2] : 0;
+  key ^= rights & CASTLING_BIT(BLACK, QUEEN_SIDE) ? POLYGLOT_RANDOM[CASTLING_KEYS + 3] : 0;
+
+  int color = board.colorToPlay();
+  int ep = board.enPassantSquare();
+  if (ep != NO_SQUARE) {
+    int file = SQ64(ep) % 8;
+    // The pawn that can capture stands beside the square the pawn passed through
+    int beside = SQ64(ep) + (color == WHITE ? -8 : 8);
+    Bitboard neighbours = (file > 0 ? SQ_BB(beside - 1) : 0) | (file < 7 ? SQ_BB(beside + 1) : 0);
+    if (board.pieces(color, PAWN) & neighbours) {
+      key ^= POLYGLOT_RANDOM[EN_PASSANT_KEYS + file];
+    }
+  }
+
+  if (color == WHITE) {
+    key ^= POLYGLOT_RANDOM[WHITE_TO_PLAY_KEY];
+  }
+  return key;
+}
+
+// Whether polyglot_key() gives the published key for every one of PUBLISHED_KEYS
+static bool keys_match_published() {
+  for (const auto &published : PUBLISHED_KEYS) {
+    Board board;
+    if (!board.replayUci(published.moves) || polyglot_key(board) != published.key) {
+      return false;
+    }
+  }
+  return true;
+}
+
+PolyglotBook::PolyglotBook() : _entries(NULL), _num_entries(0) {
+}
+
+PolyglotBook::~PolyglotBook() {
+  close();
+}
+
+BookError PolyglotBook::open(const char *path) {
+  close();
+  if (!keys_match_published()) {
+    return BOOK_BAD_KEYS;
+  }
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return BOOK_CANNOT_OPEN;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return BOOK_CANNOT_OPEN;
+  }
+  if (st.st_size == 0 || st.st_size % ENTRY_SIZE != 0) {
+    ::close(fd);
+    return BOOK_BAD_SIZE;
+  }
+  // The mapping stays valid after the descriptor is closed
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return BOOK_CANNOT_OPEN;
+  }
+  // Probes jump around the file, so reading ahead would only waste memory
+  madvise(data, st.st_size, MADV_RANDOM);
+  _entries = (const unsigned char *)data;
+  _num_entries = st.st_size / ENTRY_SIZE;
+  return BOOK_OK;
+}
+
+void PolyglotBook::close() {
+  if (_entries) {
+    munmap((void *)_entries, _num_entries * ENTRY_SIZE);
+    _entries = NULL;
+    _num_entries = 0;
+  }
+}
+
+uint64_t PolyglotBook::_key(size_t index) const {
+  return read_big_endian(_entries + index * ENTRY_SIZE, 8);
+}
+
+uint16_t PolyglotBook::_move(size_t index) const {
+  return read_big_endian(_entries + index * ENTRY_SIZE + 8, 2);
+}
+
+uint16_t PolyglotBook::_weight(size_t index) const {
+  return read_big_endian(_entries + index * ENTRY_SIZE + 10, 2);
+}
+
+bool PolyglotBook::probe(Board &board, uint64_t random, Move &move) const {
+  if (!_entries) {
+    return false;
+  }
+  uint64_t key = polyglot_key(board);
+
+  // First entry for the position
+  size_t low = 0;
+  size_t high = _num_entries;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (_key(middle) < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  uint32_t total = 0;
+  size_t end = low;
+  for (; end < _num_entries && _key(end) == key; end++) {
+    total += _weight(end);
+  }
+  if (total == 0) {
+    return false;
+  }
+
+  uint32_t pick = random % total;
+  size_t chosen = low;
+  while (pick >= _weight(chosen)) {
+    pick -= _weight(chosen);
+    chosen++;
+  }
+
+  // Bits 0-5 are the destination, 6-11 the source (as file + 8 * row), and
+  //  12-14 the promotion piece from knight = 1 to queen = 4
+  uint16_t data = _move(chosen);
+  int dest = A1 + (data & 7) * RIGHT + ((data >> 3) & 7) * UP;
+  int src = A1 + ((data >> 6) & 7) * RIGHT + ((data >> 9) & 7) * UP;
+  int promotion = (data >> 12) & 7;
+  int p = board.pieceAt(src);
+  if (promotion != 0) {
+    promotion = p > 0 ? KNIGHT + promotion - 1 : -(KNIGHT + promotion - 1);
+  } else {
+    promotion = NO_PROMOTION;
+  }
+  // Castling is written as the king capturing its own rook
+  if ((p == KING || p == -KING) && board.pieceAt(dest) == (p > 0 ? ROOK : -ROOK)) {
+    dest = dest > src ? src + 2 * RIGHT : src + 2 * LEFT;
+  }
+  move = Move(src, dest, promotion);
+  // A corrupt book, or another position with the same key, could give anything
+  return board.isLegal(move);
+}
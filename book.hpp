@@ -0,0 +1,55 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _BOOK_HPP_
+#define _BOOK_HPP_
+
+// book.hpp
+// Opening book in the Polyglot .bin format: 16-byte big-endian entries of
+// (key, move, weight, learn), sorted by the Polyglot hash of the position.
+// The file is memory-mapped rather than read, so engines on one machine
+// share a single copy of it through the page cache.
+
+#include "board.hpp"
+#include <stdint.h>
+#include <stddef.h>
+
+#define POLYGLOT_RANDOM_LEN 781  // 768 piece-square keys, 4 castling, 8 en passant files, 1 side to move
+#define POLYGLOT_START_KEY 0x463B96181691FC9CULL  // Published key of the starting position
+
+// Result of PolyglotBook::open
+enum BookError {
+  BOOK_OK,
+  BOOK_BAD_KEYS,  // polyglot_key() does not give the published keys, so no book can be trusted
+  BOOK_CANNOT_OPEN,
+  BOOK_BAD_SIZE  // Empty, or not a whole number of entries
+};
+
+// Polyglot hash of the position, which is unrelated to Board::hash()
+uint64_t polyglot_key(const Board &board);
+
+class PolyglotBook {
+  public:
+    PolyglotBook();
+    ~PolyglotBook();
+    PolyglotBook(const PolyglotBook &) = delete;
+    PolyglotBook &operator=(const PolyglotBook &) = delete;
+
+    // Maps the book at path, closing any book already open
+    BookError open(const char *path);
+    void close();
+    bool isOpen() const { return _entries != NULL; }
+
+    // Chooses one of the book moves for board, each with a chance in proportion
+    //  to its weight, using random to pick. Returns false if the position is not
+    //  in the book. Nothing is allocated, so probing costs a binary search
+    bool probe(Board &board, uint64_t random, Move &move) const;
+
+  private:
+    const unsigned char *_entries;  // The mapped file
+    size_t _num_entries;
+
+    uint64_t _key(size_t index) const;
+    uint16_t _move(size_t index) const;
+    uint16_t _weight(size_t index) const;
+};
+
+#endif // _BOOK_HPP_
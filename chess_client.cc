@@ -1,18 +1,29 @@
 #define _GLIBCXX_USE_CXX11_ABI 0
 #include "board.hpp"
+#include "search.hpp"
 #include <iostream>
 #include <string>
-#include <cassert>
 
+// Why tryMove rejected a move, indexed by MoveResult
+static const char *MOVE_RESULT_MESSAGES[] = {
+  "",
+  "Must move a piece of the side to play",
+  "Piece cannot be moved there",
+  "Pawns reaching the last rank must promote to N, B, R or Q, and no other move promotes",
+  "Cannot castle without the right, through pieces, or out of or through check",
+  "King must not be in check"
+};
 
 // TODO: Keep a list of moves played
-// TODO: Allow lists of moves to be submitted for quick replaying
 // TODO: Allow interactive output of FEN notation,
 int main() {
   Board b("rnb1kb1r/2q2ppp/p2ppn2/8/1p1NPP2/P1NB4/1PP1Q1PP/R1B1K2R w KQkq - 0 10");
+  KeyHistory history;  // So the engine knows which positions it would repeat
+  history.reset(b);
+  TranspositionTable tt(16);
   std::cout << b << std::endl; 
   while (true) {
-    std::vector<Move> move_list = b.generateMoves();
+    MoveList move_list = b.generateMoves();
     for (uint32_t i = 0; i < move_list.size(); i++) {
       /*
       std::cout << "Possible move: " << sq_name(move_list[i].src) << " to " << sq_name(move_list[i].dest);
@@ -25,24 +36,53 @@ int main() {
     std::string move;
     std::cout << "Enter Move: ";
     std::cin >> move;
+    if (move == "go") {
+      // Let the engine pick a move for whichever side is to play
+      Search search(tt);
+      SearchLimits limits;
+      limits.movetime_ms = 2000;
+      SearchResult result = search.run(b, limits, &history);
+      if (result.best_move == NO_MOVE) {
+        std::cout << "No legal moves" << std::endl;
+        continue;
+      }
+      std::cout << "Engine plays " << sq_name(result.best_move.src) << sq_name(result.best_move.dest)
+                << get_symbol(result.best_move.promotion) << " (score " << result.score
+                << ", depth " << result.depth << ", " << result.nodes << " nodes)" << std::endl;
+      Undo undo;
+      b.doMove(result.best_move, undo);
+      history.push(b.hash());
+      std::cout << b << std::endl;
+      std::cout << b.to_fen() << std::endl;
+      continue;
+    }
+    if (move == "moves" || move == "pgn") {
+      // Replay the rest of the line, as UCI moves (e2e4 e7e5) or PGN movetext (1. e4 e5)
+      std::string list;
+      std::getline(std::cin, list);
+      int played = 0;
+      bool ok = move == "moves" ? b.replayUci(list, REPLAY_VALIDATE, &played, &history)
+                                : b.replaySan(list, REPLAY_VALIDATE, &played, &history);
+      if (!ok) {
+        std::cout << "Stopped at illegal move " << played + 1 << std::endl;
+      }
+      std::cout << b << std::endl;
+      std::cout << b.to_fen() << std::endl;
+      continue;
+    }
     if (move.length() < 4 || move.length() > 5) {
-      std::cout << "Must give move in format <fromSquare><toSquare><optionalPromotion>" << std::endl;
+      std::cout << "Must give move in format <fromSquare><toSquare><optionalPromotion>, go, moves <list> or pgn <movetext>" << std::endl;
       continue;
     }
     int src = get_pos_rankfile(move.substr(0,2));
     int dest = get_pos_rankfile(move.substr(2,4));
-    int promotion;
-    if (move.length() > 4) {
-      promotion = symbol_to_piece(move.substr(4,5).c_str()[0]);
-      if (promotion == KNIGHT || promotion == -KNIGHT || promotion == -QUEEN || promotion == QUEEN ||
-          promotion == ROOK || promotion == -ROOK || promotion == BISHOP || promotion == -BISHOP) {
-      } else {
-        assert(false);
-      }
-    } else {
-      promotion = NO_PROMOTION;
+    int promotion = move.length() > 4 ? symbol_to_piece(move[4]) : NO_PROMOTION;
+    MoveResult result = b.tryMove(src, dest, promotion);
+    if (result != MOVE_OK) {
+      std::cout << MOVE_RESULT_MESSAGES[result] << std::endl;
+      continue;
     }
-    b.makeMove(src, dest, promotion);
+    history.push(b.hash());
     std::cout << b << std::endl; 
     std::cout << b.to_fen() << std::endl; 
   }
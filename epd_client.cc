@@ -0,0 +1,258 @@
+/*  epd_client.cc
+ *  Description: Runs every position of an EPD file through the engine,
+ *               checking perft counts (D1 20; D2 400; ...) and best or
+ *               avoid moves (bm Nf3; am Qxb2;), spread over a thread pool.
+ *               The file is streamed in batches, so its size doesn't matter.
+*/
+#define _GLIBCXX_USE_CXX11_ABI 0
+#include "board.hpp"
+#include "perft_table.hpp"
+#include "search.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct EpdOptions {
+  int threads;
+  size_t hash_mb;  // Perft table shared by every position
+  size_t search_hash_mb;  // TT of each worker, for the bm and am positions
+  int max_perft_depth;  // Deeper perft counts in the file are skipped
+  SearchLimits limits;  // For bm and am positions
+  int batch_size;  // Lines read and run at a time
+};
+
+// One line of the file and what came of it
+struct EpdJob {
+  long line_number;
+  std::string line;
+  bool ran;  // False for blank lines and comments
+  bool failed;
+  long nodes;
+  std::string report;
+};
+
+static std::string_view trim(std::string_view s) {
+  size_t start = s.find_first_not_of(" \t\r\n");
+  if (start == std::string_view::npos) {
+    return std::string_view();
+  }
+  size_t end = s.find_last_not_of(" \t\r\n");
+  return s.substr(start, end - start + 1);
+}
+
+// Removes and returns the next space separated word of s
+static std::string_view next_word(std::string_view &s) {
+  s = trim(s);
+  size_t end = s.find(' ');
+  std::string_view word = s.substr(0, end);
+  s.remove_prefix(end == std::string_view::npos ? s.size() : end);
+  return word;
+}
+
+static bool is_number(std::string_view s) {
+  return !s.empty() && s.find_first_not_of("0123456789") == std::string_view::npos;
+}
+
+// SAN without check marks or annotations, so "Qxf7#" matches "Qxf7"
+static std::string_view bare_san(std::string_view san) {
+  size_t end = san.find_first_of("+#!?");
+  return san.substr(0, end);
+}
+
+// Each worker keeps one table for its searches, cleared for every position so
+//  that a result doesn't depend on which positions the worker ran before
+static thread_local std::unique_ptr<TranspositionTable> search_tt;
+
+static void run_job(EpdJob &job, const EpdOptions &options, PerftTable *table) {
+  job.ran = false;
+  job.failed = false;
+  job.nodes = 0;
+  job.report.clear();
+  std::string_view rest = trim(job.line);
+  if (rest.empty() || rest[0] == '#') {
+    return;
+  }
+  job.ran = true;
+
+  // The position is the first four fields, perhaps followed by the move counters
+  std::string_view line = rest;
+  for (int i = 0; i < 4; i++) {
+    next_word(rest);
+  }
+  std::string_view after_counters = rest;
+  if (is_number(next_word(after_counters)) && is_number(next_word(after_counters))) {
+    rest = after_counters;
+  }
+  std::string_view fen = line.substr(0, line.size() - rest.size());
+
+  Board board;
+  FenError error = board.setFen(fen);
+  if (error != FEN_OK) {
+    job.failed = true;
+    job.report = " bad FEN (error " + std::to_string(error) + ")";
+    return;
+  }
+
+  // Operations are "opcode operands;" with a ';' before the first one optional
+  std::string id;
+  std::string perft_report;
+  std::vector<std::string_view> best_moves;
+  std::vector<std::string_view> avoid_moves;
+  while (!trim(rest).empty()) {
+    size_t end = rest.find(';');
+    std::string_view operation = rest.substr(0, end);
+    rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+    std::string_view opcode = next_word(operation);
+    operation = trim(operation);
+
+    if (opcode.size() >= 2 && opcode[0] == 'D' && is_number(opcode.substr(1))) {
+      int depth = std::atoi(std::string(opcode.substr(1)).c_str());
+      if (depth > options.max_perft_depth || job.failed) {
+        continue;
+      }
+      long expected = std::atol(std::string(operation).c_str());
+      long count = table ? board.perft(depth, *table) : board.perft(depth);
+      job.nodes += count;
+      if (count != expected) {
+        job.failed = true;
+        perft_report += " D" + std::to_string(depth) + " expected " + std::to_string(expected)
+          + " got " + std::to_string(count);
+      } else {
+        perft_report += " D" + std::to_string(depth) + " " + std::to_string(count);
+      }
+    } else if (opcode == "bm" || opcode == "am") {
+      std::vector<std::string_view> &moves = opcode == "bm" ? best_moves : avoid_moves;
+      while (!trim(operation).empty()) {
+        moves.push_back(bare_san(next_word(operation)));
+      }
+    } else if (opcode == "id") {
+      id = std::string(operation);
+    }
+  }
+
+  if (!best_moves.empty() || !avoid_moves.empty()) {
+    if (!search_tt) {
+      search_tt.reset(new TranspositionTable(options.search_hash_mb));
+    } else {
+      search_tt->clear();
+    }
+    Search search(*search_tt);
+    SearchResult result = search.run(board, options.limits);
+    job.nodes += result.nodes;
+    std::string played = result.best_move == NO_MOVE ? "(none)" : board.toSan(result.best_move);
+    bool good = best_moves.empty();
+    for (uint32_t i = 0; i < best_moves.size(); i++) {
+      good |= best_moves[i] == bare_san(played);
+    }
+    for (uint32_t i = 0; i < avoid_moves.size(); i++) {
+      good &= avoid_moves[i] != bare_san(played);
+    }
+    job.failed |= !good;
+    job.report += (best_moves.empty() ? " am" : " bm");
+    for (std::string_view san : best_moves.empty() ? avoid_moves : best_moves) {
+      job.report += " ";
+      job.report += san;
+    }
+    job.report += ", played " + played + " (depth " + std::to_string(result.depth) + ")";
+  }
+  job.report = perft_report + job.report;
+  if (!id.empty()) {
+    job.report += " " + id;
+  }
+  if (job.failed) {
+    job.report += "\n    " + std::string(fen);
+  }
+}
+
+int main(int argc, char **argv) {
+  EpdOptions options;
+  options.threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+  options.hash_mb = 0;
+  options.search_hash_mb = 16;
+  options.max_perft_depth = 6;
+  options.limits.depth = 6;
+  options.batch_size = 256;
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      options.threads = std::atoi(argv[++i]);
+    } else if (arg == "--hash" && i + 1 < argc) {
+      options.hash_mb = std::strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--search-hash" && i + 1 < argc) {
+      options.search_hash_mb = std::max(1UL, std::strtoul(argv[++i], NULL, 10));
+    } else if (arg == "--max-depth" && i + 1 < argc) {
+      options.max_perft_depth = std::atoi(argv[++i]);
+    } else if (arg == "--depth" && i + 1 < argc) {
+      options.limits.depth = std::atoi(argv[++i]);
+    } else if (arg == "--movetime" && i + 1 < argc) {
+      options.limits.movetime_ms = std::atol(argv[++i]);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      options.batch_size = std::max(1, std::atoi(argv[++i]));
+    } else {
+      path = arg;
+    }
+  }
+  if (path.empty()) {
+    std::cerr << "Usage: epd [--threads N] [--hash MB] [--search-hash MB] [--max-depth D] [--depth D]"
+              << " [--movetime MS] [--batch LINES] <file.epd | ->" << std::endl;
+    return 1;
+  }
+
+  std::ifstream file;
+  if (path != "-") {
+    file.open(path);
+    if (!file) {
+      std::cerr << "Cannot open " << path << std::endl;
+      return 1;
+    }
+  }
+  std::istream &in = path == "-" ? std::cin : file;
+
+  ThreadPool pool(options.threads);
+  std::unique_ptr<PerftTable> table;
+  if (options.hash_mb > 0) {
+    table.reset(new PerftTable(options.hash_mb));
+  }
+
+  // Lines are read a batch at a time and the results printed in file order.
+  //  The jobs, and the capacity of their strings, are reused for every batch
+  std::vector<EpdJob> jobs(options.batch_size);
+  long line_number = 0;
+  long positions = 0;
+  long failures = 0;
+  long nodes = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (in) {
+    int count = 0;
+    while (count < options.batch_size && std::getline(in, jobs[count].line)) {
+      jobs[count].line_number = ++line_number;
+      EpdJob *job = &jobs[count++];
+      pool.submit([job, &options, &table]() { run_job(*job, options, table.get()); });
+    }
+    pool.wait();
+
+    for (int i = 0; i < count; i++) {
+      if (!jobs[i].ran) {
+        continue;
+      }
+      positions++;
+      failures += jobs[i].failed;
+      nodes += jobs[i].nodes;
+      std::cout << jobs[i].line_number << (jobs[i].failed ? ": FAIL" : ": ok") << jobs[i].report << "\n";
+    }
+    std::cout.flush();
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Positions: " << positions << "  Failed: " << failures << "  Nodes: " << nodes
+            << "  Time: " << seconds << "s  NPS: " << (long)(nodes / (seconds > 0 ? seconds : 1)) << std::endl;
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// eval.cc
+// Piece-square tables and the tapered evaluation
+
+#include "eval.hpp"
+#include "board.hpp"
+#include <assert.h>
+
+int EVAL_MG[2][7][64];
+int EVAL_EG[2][7][64];
+const int PHASE_WEIGHTS[7] = {0, 0, 1, 1, 2, 4, 0};
+
+static const int MATERIAL_MG[7] = {0, 82, 337, 365, 477, 1025, 0};
+static const int MATERIAL_EG[7] = {0, 94, 281, 297, 512, 936, 0};
+
+// Piece-square tables from white's point of view, laid out as the board is
+//  drawn: the first row is rank 8. Pieces other than pawns and kings use the
+//  same table in the middlegame and endgame.
+static const int PAWN_MG[64] = {
+   0,   0,   0,   0,   0,   0,   0,   0,
+  50,  50,  50,  50,  50,  50,  50,  50,
+  10,  10,  20,  30,  30,  20,  10,  10,
+   5,   5,  10,  25,  25,  10,   5,   5,
+   0,   0,   0,  20,  20,   0,   0,   0,
+   5,  -5, -10,   0,   0, -10,  -5,   5,
+   5,  10,  10, -20, -20,  10,  10,   5,
+   0,   0,   0,   0,   0,   0,   0,   0
+};
+static const int PAWN_EG[64] = {
+   0,   0,   0,   0,   0,   0,   0,   0,
+  80,  80,  80,  80,  80,  80,  80,  80,
+  50,  50,  50,  50,  50,  50,  50,  50,
+  30,  30,  30,  30,  30,  30,  30,  30,
+  15,  15,  15,  15,  15,  15,  15,  15,
+   5,   5,   5,   5,   5,   5,   5,   5,
+   0,   0,   0,   0,   0,   0,   0,   0,
+   0,   0,   0,   0,   0,   0,   0,   0
+};
+static const int KNIGHT_PST[64] = {
+ -50, -40, -30, -30, -30, -30, -40, -50,
+ -40, -20,   0,   0,   0,   0, -20, -40,
+ -30,   0,  10,  15,  15,  10,   0, -30,
+ -30,   5,  15,  20,  20,  15,   5, -30,
+ -30,   0,  15,  20,  20,  15,   0, -30,
+ -30,   5,  10,  15,  15,  10,   5, -30,
+ -40, -20,   0,   5,   5,   0, -20, -40,
+ -50, -40, -30, -30, -30, -30, -40, -50
+};
+static const int BISHOP_PST[64] = {
+ -20, -10, -10, -10, -10, -10, -10, -20,
+ -10,   0,   0,   0,   0,   0,   0, -10,
+ -10,   0,   5,  10,  10,   5,   0, -10,
+ -10,   5,   5,  10,  10,   5,   5, -10,
+ -10,   0,  10,  10,  10,  10,   0, -10,
+ -10,  10,  10,  10,  10,  10,  10, -10,
+ -10,   5,   0,   0,   0,   0,   5, -10,
+ -20, -10, -10, -10, -10, -10, -10, -20
+};
+static const int ROOK_PST[64] = {
+   0,   0,   0,   0,   0,   0,   0,   0,
+   5,  10,  10,  10,  10,  10,  10,   5,
+  -5,   0,   0,   0,   0,   0,   0,  -5,
+  -5,   0,   0,   0,   0,   0,   0,  -5,
+  -5,   0,   0,   0,   0,   0,   0,  -5,
+  -5,   0,   0,   0,   0,   0,   0,  -5,
+  -5,   0,   0,   0,   0,   0,   0,  -5,
+   0,   0,   0,   5,   5,   0,   0,   0
+};
+static const int QUEEN_PST[64] = {
+ -20, -10, -10,  -5,  -5, -10, -10, -20,
+ -10,   0,   0,   0,   0,   0,   0, -10,
+ -10,   0,   5,   5,   5,   5,   0, -10,
+  -5,   0,   5,   5,   5,   5,   0,  -5,
+   0,   0,   5,   5,   5,   5,   0,  -5,
+ -10,   5,   5,   5,   5,   5,   0, -10,
+ -10,   0,   5,   0,   0,   0,   0, -10,
+ -20, -10, -10,  -5,  -5, -10, -10, -20
+};
+// The king hides behind its pawns in the middlegame, and heads for the centre in the endgame
+static const int KING_MG[64] = {
+ -30, -40, -40, -50, -50, -40, -40, -30,
+ -30, -40, -40, -50, -50, -40, -40, -30,
+ -30, -40, -40, -50, -50, -40, -40, -30,
+ -30, -40, -40, -50, -50, -40, -40, -30,
+ -20, -30, -30, -40, -40, -30, -30, -20,
+ -10, -20, -20, -20, -20, -20, -20, -10,
+  20,  20,   0,   0,   0,   0,  20,  20,
+  20,  30,  10,   0,   0,  10,  30,  20
+};
+static const int KING_EG[64] = {
+ -50, -40, -30, -20, -20, -30, -40, -50,
+ -30, -20, -10,   0,   0, -10, -20, -30,
+ -30, -10,  20,  30,  30,  20, -10, -30,
+ -30, -10,  30,  40,  40,  30, -10, -30,
+ -30, -10,  30,  40,  40,  30, -10, -30,
+ -30, -10,  20,  30,  30,  20, -10, -30,
+ -30, -30,   0,   0,   0,   0, -30, -30,
+ -50, -30, -30, -30, -30, -30, -30, -50
+};
+
+static const int *PST_MG[7] = {0, PAWN_MG, KNIGHT_PST, BISHOP_PST, ROOK_PST, QUEEN_PST, KING_MG};
+static const int *PST_EG[7] = {0, PAWN_EG, KNIGHT_PST, BISHOP_PST, ROOK_PST, QUEEN_PST, KING_EG};
+
+static void fill_tables() {
+  for (int piece = PAWN; piece <= KING; piece++) {
+    for (int sq = 0; sq < 64; sq++) {
+      int rank = sq / 8;
+      int file = sq % 8;
+      // Tables are drawn from white's side, so black reads them upside down
+      int white_index = (7 - rank) * 8 + file;
+      int black_index = rank * 8 + file;
+      EVAL_MG[WHITE][piece][sq] = MATERIAL_MG[piece] + PST_MG[piece][white_index];
+      EVAL_EG[WHITE][piece][sq] = MATERIAL_EG[piece] + PST_EG[piece][white_index];
+      EVAL_MG[BLACK][piece][sq] = -(MATERIAL_MG[piece] + PST_MG[piece][black_index]);
+      EVAL_EG[BLACK][piece][sq] = -(MATERIAL_EG[piece] + PST_EG[piece][black_index]);
+    }
+  }
+}
+
+void init_eval() {
+  static bool initialized = (fill_tables(), true);
+  (void)initialized;
+}
+
+int Evaluator::_taper(int mg, int eg, int phase) {
+  if (phase > MAX_PHASE) {
+    phase = MAX_PHASE;  // Possible after promotions
+  }
+  return (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+int Evaluator::evaluate(const Board &board) {
+  int score = _taper(board.mgScore(), board.egScore(), board.phase());
+#ifdef EVAL_DEBUG
+  assert((board.colorToPlay() == WHITE ? score : -score) == evaluateFromScratch(board));
+#endif
+  return board.colorToPlay() == WHITE ? score : -score;
+}
+
+int Evaluator::evaluateFromScratch(const Board &board) {
+  int mg = 0;
+  int eg = 0;
+  int phase = 0;
+  for (int color = WHITE; color <= BLACK; color++) {
+    for (int piece = PAWN; piece <= KING; piece++) {
+      Bitboard pieces = board.pieces(color, piece);
+      while (pieces) {
+        int sq = pop_lsb(pieces);
+        mg += EVAL_MG[color][piece][sq];
+        eg += EVAL_EG[color][piece][sq];
+        phase += PHASE_WEIGHTS[piece];
+      }
+    }
+  }
+  int score = _taper(mg, eg, phase);
+  return board.colorToPlay() == WHITE ? score : -score;
+}
@@ -0,0 +1,42 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _EVAL_HPP_
+#define _EVAL_HPP_
+
+// eval.hpp
+// Static evaluation: material plus piece-square tables, with separate
+// middlegame and endgame values blended by how much material is left.
+// The Board keeps the sums up to date as pieces are added and removed,
+// so evaluating a position doesn't have to look at the board at all.
+
+#include <stdint.h>
+
+#define MAX_PHASE 24  // Game phase with all pieces on the board
+
+// Material plus piece-square value of each piece on each square, in centipawns.
+//  Indexed by color, piece type (PAWN..KING) and bitboard square. Black's
+//  values are negated, so the sums are always from white's point of view
+extern int EVAL_MG[2][7][64];
+extern int EVAL_EG[2][7][64];
+// How much each piece type counts towards the game phase
+extern const int PHASE_WEIGHTS[7];
+
+// Fills in the tables. Safe to call more than once.
+void init_eval();
+
+class Board;
+
+class Evaluator {
+  public:
+    // Score of board in centipawns from the side to move's point of view,
+    //  using the sums the Board keeps. Building with -DEVAL_DEBUG checks
+    //  it against evaluateFromScratch() on every call
+    static int evaluate(const Board &board);
+    // The same score, computed by scanning every piece on the board
+    static int evaluateFromScratch(const Board &board);
+
+  private:
+    // Blends the middlegame and endgame scores by phase
+    static int _taper(int mg, int eg, int phase);
+};
+
+#endif // _EVAL_HPP_
@@ -0,0 +1,145 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// movepick.cc
+// Staged move ordering: hash move, captures by MVV-LVA, killers, quiets by
+// history, then the captures that lose material by SEE
+
+#include "movepick.hpp"
+#include "tt.hpp"
+#include <cstdlib>
+
+MovePicker::MovePicker(Board &board, uint16_t tt_move, const Move killers[2], const int history[2][64][64],
+                       bool captures_only)
+  : _board(&board), _stage(STAGE_HASH_MOVE), _captures_only(captures_only), _killer_index(0),
+    _history(history), _current(0), _bad_index(0) {
+  _tt_move = decode_move(tt_move, board.colorToPlay());
+  _has_tt_move = tt_move != NO_TT_MOVE && board.isLegal(_tt_move)
+    && (!captures_only || board.isCaptureOrPromotion(_tt_move));
+  for (int i = 0; i < 2; i++) {
+    _killers[i] = killers[i];
+  }
+}
+
+bool MovePicker::next(Move &move) {
+  while (true) {
+    switch (_stage) {
+      case STAGE_HASH_MOVE:
+        _stage = STAGE_GENERATE_CAPTURES;
+        if (_has_tt_move) {
+          move = _tt_move;
+          return true;
+        }
+        break;
+
+      case STAGE_GENERATE_CAPTURES:
+        _board->generateMoves(_moves, GEN_CAPTURES);
+        _score_captures();
+        _stage = STAGE_CAPTURES;
+        break;
+
+      // Captures that lose material are put off until after the quiet
+      //  moves, or dropped altogether when only captures are wanted
+      case STAGE_CAPTURES:
+        while (_pick_best(move)) {
+          if (_has_tt_move && move == _tt_move) {
+            continue;
+          }
+          if (_board->see(move) < 0) {
+            if (!_captures_only) {
+              _bad_captures.push_back(move);
+            }
+            continue;
+          }
+          return true;
+        }
+        _stage = _captures_only ? STAGE_DONE : STAGE_KILLERS;
+        break;
+
+      // Killers were quiet where they caused a cutoff, and must be quiet here
+      //  too, or they would be returned again by the capture stage
+      case STAGE_KILLERS:
+        while (_killer_index < 2) {
+          move = _killers[_killer_index++];
+          if (move == NO_MOVE || (_has_tt_move && move == _tt_move)
+              || (_killer_index == 2 && move == _killers[0])) {
+            continue;
+          }
+          if (!_board->isCaptureOrPromotion(move) && _board->isLegal(move)) {
+            return true;
+          }
+        }
+        _stage = STAGE_GENERATE_QUIETS;
+        break;
+
+      case STAGE_GENERATE_QUIETS:
+        _board->generateMoves(_moves, GEN_QUIETS);
+        _score_quiets();
+        _stage = STAGE_QUIETS;
+        break;
+
+      case STAGE_QUIETS:
+        while (_pick_best(move)) {
+          if (!_already_tried(move)) {
+            return true;
+          }
+        }
+        _stage = STAGE_BAD_CAPTURES;
+        break;
+
+      case STAGE_BAD_CAPTURES:
+        if (_bad_index < _bad_captures.size()) {
+          move = _bad_captures[_bad_index++];
+          return true;
+        }
+        _stage = STAGE_DONE;
+        break;
+
+      default:
+        return false;
+    }
+  }
+}
+
+bool MovePicker::_already_tried(const Move &move) {
+  return (_has_tt_move && move == _tt_move) || move == _killers[0] || move == _killers[1];
+}
+
+bool MovePicker::_pick_best(Move &move) {
+  if (_current >= _moves.size()) {
+    return false;
+  }
+  uint32_t best = _current;
+  for (uint32_t i = _current + 1; i < _moves.size(); i++) {
+    if (_scores[i] > _scores[best]) {
+      best = i;
+    }
+  }
+  std::swap(_moves[_current], _moves[best]);
+  std::swap(_scores[_current], _scores[best]);
+  move = _moves[_current++];
+  return true;
+}
+
+// Most valuable victim first, and of those the least valuable attacker.
+//  Promotions count the piece gained as the victim
+void MovePicker::_score_captures() {
+  _current = 0;
+  for (uint32_t i = 0; i < _moves.size(); i++) {
+    int victim = std::abs(_board->pieceAt(_moves[i].dest));
+    if (victim == EMPTY && _moves[i].promotion == NO_PROMOTION) {
+      victim = PAWN;  // En passant
+    }
+    int score = PIECE_VALUES[victim] * 8 - PIECE_VALUES[std::abs(_board->pieceAt(_moves[i].src))] / 100;
+    if (_moves[i].promotion != NO_PROMOTION) {
+      score += PIECE_VALUES[std::abs(_moves[i].promotion)] * 8;
+    }
+    _scores[i] = score;
+  }
+}
+
+void MovePicker::_score_quiets() {
+  _current = 0;
+  int color = _board->colorToPlay();
+  for (uint32_t i = 0; i < _moves.size(); i++) {
+    _scores[i] = _history[color][SQ64(_moves[i].src)][SQ64(_moves[i].dest)];
+  }
+}
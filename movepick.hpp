@@ -0,0 +1,66 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _MOVEPICK_HPP_
+#define _MOVEPICK_HPP_
+
+// movepick.hpp
+// Hands the search one move at a time, most promising first. Moves are
+// generated in stages, so when the hash move or a good capture causes a
+// cutoff, the quiet moves are never generated or sorted at all.
+
+#include "board.hpp"
+#include <stdint.h>
+
+// Stages of a MovePicker, in the order they are tried
+enum PickStage {
+  STAGE_HASH_MOVE,
+  STAGE_GENERATE_CAPTURES,
+  STAGE_CAPTURES,
+  STAGE_KILLERS,
+  STAGE_GENERATE_QUIETS,
+  STAGE_QUIETS,
+  STAGE_BAD_CAPTURES,
+  STAGE_DONE
+};
+
+class MovePicker {
+  public:
+    // tt_move is the packed hash move (or NO_TT_MOVE), killers are quiet moves
+    //  that caused a cutoff at this ply elsewhere in the tree, and history
+    //  scores quiet moves by [color][source][destination] bitboard squares.
+    //  None of them need to be legal here, they are checked before being returned.
+    //  For quiescence, captures_only returns just the captures that do not lose material.
+    MovePicker(Board &board, uint16_t tt_move, const Move killers[2], const int history[2][64][64],
+               bool captures_only = false);
+
+    // Sets move to the next move to search and returns true, or returns
+    //  false when every legal move has been returned once
+    bool next(Move &move);
+
+  private:
+    Board *_board;
+    int _stage;
+    bool _captures_only;
+    Move _tt_move;
+    bool _has_tt_move;
+    Move _killers[2];
+    int _killer_index;
+    const int (*_history)[64][64];
+
+    // The moves of the current stage and their scores. Moves are picked
+    //  by selection, so only as much of the list is sorted as is used
+    MoveList _moves;
+    int _scores[MAX_MOVES];
+    uint32_t _current;
+    // Captures that lose material by SEE, in the order they were picked
+    MoveList _bad_captures;
+    uint32_t _bad_index;
+
+    // Whether move was already returned by the hash move or killer stages
+    bool _already_tried(const Move &move);
+    // Removes the highest scoring remaining move, returning false if none are left
+    bool _pick_best(Move &move);
+    void _score_captures();
+    void _score_quiets();
+};
+
+#endif // _MOVEPICK_HPP_
@@ -0,0 +1,60 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// perft_table.cc
+// Lockless bucketed hash table for perft counts
+
+#include "perft_table.hpp"
+
+#define DEPTH_BITS 8
+#define DEPTH_MASK ((1ULL << DEPTH_BITS) - 1)
+
+PerftTable::PerftTable(size_t size_mb) {
+  size_t num_buckets = 1;
+  while (num_buckets * 2 * sizeof(Bucket) <= size_mb * 1024 * 1024) {
+    num_buckets *= 2;
+  }
+  _buckets.reset(new Bucket[num_buckets]);
+  _mask = num_buckets - 1;
+  clear();
+}
+
+void PerftTable::clear() {
+  for (size_t i = 0; i <= _mask; i++) {
+    for (int j = 0; j < PERFT_BUCKET_SIZE; j++) {
+      _buckets[i].entries[j].key.store(0, std::memory_order_relaxed);
+      _buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool PerftTable::probe(uint64_t hash, int depth, uint64_t &count) const {
+  const Bucket &bucket = _buckets[hash & _mask];
+  for (int i = 0; i < PERFT_BUCKET_SIZE; i++) {
+    uint64_t key = bucket.entries[i].key.load(std::memory_order_relaxed);
+    uint64_t data = bucket.entries[i].data.load(std::memory_order_relaxed);
+    if ((key ^ data) == hash && (int)(data & DEPTH_MASK) == depth) {
+      count = data >> DEPTH_BITS;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerftTable::store(uint64_t hash, int depth, uint64_t count) {
+  Bucket &bucket = _buckets[hash & _mask];
+  uint64_t data = (count << DEPTH_BITS) | (uint64_t)depth;
+
+  // Deeper counts save the most work, so the shallowest entry is replaced.
+  //  Empty entries have depth 0, so they are always used first
+  int replace = 0;
+  int replace_depth = DEPTH_MASK + 1;
+  for (int i = 0; i < PERFT_BUCKET_SIZE; i++) {
+    uint64_t entry_data = bucket.entries[i].data.load(std::memory_order_relaxed);
+    int entry_depth = (int)(entry_data & DEPTH_MASK);
+    if (entry_depth < replace_depth) {
+      replace = i;
+      replace_depth = entry_depth;
+    }
+  }
+  bucket.entries[replace].key.store(hash ^ data, std::memory_order_relaxed);
+  bucket.entries[replace].data.store(data, std::memory_order_relaxed);
+}
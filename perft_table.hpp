@@ -0,0 +1,44 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _PERFT_TABLE_HPP_
+#define _PERFT_TABLE_HPP_
+
+// perft_table.hpp
+// Fixed-size hash table caching perft subtree counts, so a position reached
+// through different move orders is only counted once per depth.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+#define PERFT_BUCKET_SIZE 4  // Entries per bucket, so a bucket fills one 64-byte cache line
+
+class PerftTable {
+  public:
+    // Allocates a table of about size_mb megabytes (rounded down to a power of two buckets)
+    PerftTable(size_t size_mb);
+
+    // Looks up the node count below position hash to depth. Returns whether it was found
+    bool probe(uint64_t hash, int depth, uint64_t &count) const;
+    // Stores a node count, replacing the shallowest entry in the bucket if it is full
+    void store(uint64_t hash, int depth, uint64_t count);
+    // Empties the table
+    void clear();
+
+  private:
+    // Entries are written without locks, so several threads may share a table.
+    //  The key is stored XORed with the data, so an entry torn by two threads
+    //  writing at once will fail the key check rather than give a wrong count.
+    struct Entry {
+      std::atomic<uint64_t> key;  // Position hash XOR data
+      std::atomic<uint64_t> data;  // Node count in the high 56 bits, depth in the low 8
+    };
+    struct Bucket {
+      Entry entries[PERFT_BUCKET_SIZE];
+    };
+
+    std::unique_ptr<Bucket[]> _buckets;
+    size_t _mask;  // Number of buckets - 1, for indexing with the low bits of the hash
+};
+
+#endif // _PERFT_TABLE_HPP_
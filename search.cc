@@ -0,0 +1,360 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// search.cc
+// Negamax alpha-beta search with iterative deepening
+
+#include "search.hpp"
+#include "eval.hpp"
+#include "movepick.hpp"
+#include <cstring>
+#include <memory>
+#include <thread>
+
+Search::Search(TranspositionTable &tt, std::atomic<bool> *stop_flag)
+  : _tt(&tt), _own_stop_flag(false), _stop_flag(stop_flag ? stop_flag : &_own_stop_flag),
+    _thread_index(0), _stopped(false), _nodes(0), _root_depth(0) {
+}
+
+// Mate scores are stored relative to the position rather than the root,
+//  so they stay correct when the position is reached at another ply
+static int score_to_tt(int score, int ply) {
+  if (score >= MATE_BOUND) {
+    return score + ply;
+  } else if (score <= -MATE_BOUND) {
+    return score - ply;
+  }
+  return score;
+}
+
+static int score_from_tt(int score, int ply) {
+  if (score >= MATE_BOUND) {
+    return score - ply;
+  } else if (score <= -MATE_BOUND) {
+    return score + ply;
+  }
+  return score;
+}
+
+SearchResult Search::run(Board &board, const SearchLimits &limits, const KeyHistory *history) {
+  _limits = limits;
+  _start = std::chrono::steady_clock::now();
+  // A search sharing its stop flag is part of a ParallelSearch, which
+  //  resets the flag and starts the table's new generation itself
+  if (_stop_flag == &_own_stop_flag) {
+    _own_stop_flag = false;
+    _tt->newSearch();
+  }
+  _stopped = false;
+  _nodes = 0;
+  if (history) {
+    _keys = *history;
+  } else {
+    _keys.reset(board);
+  }
+  for (int ply = 0; ply < MAX_PLY; ply++) {
+    _killers[ply][0] = _killers[ply][1] = NO_MOVE;
+  }
+  memset(_history, 0, sizeof(_history));
+
+  SearchResult result;
+  result.best_move = NO_MOVE;
+  result.score = 0;
+  result.depth = 0;
+  result.nodes = 0;
+
+  // Nothing to search if the game is already over
+  if (board.generateMoves().empty()) {
+    result.score = board.inCheck() ? -MATE_SCORE : 0;
+    return result;
+  }
+
+  int step = _thread_index % 2 == 1 ? 2 : 1;
+  for (int depth = 1; depth < MAX_PLY; depth += step) {
+    if (limits.depth > 0 && depth > limits.depth) {
+      break;
+    }
+    _root_depth = depth;
+    int score = _negamax(board, depth, -INFINITE_SCORE, INFINITE_SCORE, 0);
+    if (_stopped) {
+      break;  // This iteration is incomplete, so keep the last one
+    }
+
+    result.score = score;
+    result.depth = depth;
+    result.pv.assign(_pv[0], _pv[0] + _pv_length[0]);
+    result.best_move = result.pv[0];
+    if (_info_callback) {
+      result.nodes = _nodes;
+      _info_callback(result);
+    }
+
+    if (_should_stop()) {
+      break;
+    }
+  }
+  result.nodes = _nodes;
+  return result;
+}
+
+bool Search::_should_stop() {
+  if (_thread_index == 0 && _root_depth <= 1) {
+    return false;  // Always finish the first iteration, so there is a move to play
+  }
+  if (*_stop_flag) {
+    return true;
+  }
+  if (_limits.nodes > 0 && _nodes >= _limits.nodes) {
+    return true;
+  }
+  if (_limits.movetime_ms > 0) {
+    long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - _start).count();
+    if (elapsed >= _limits.movetime_ms) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ParallelSearch::ParallelSearch(TranspositionTable &tt, int threads)
+  : _tt(&tt), _threads(threads < 1 ? 1 : threads), _stop_flag(false), _stops(0) {
+}
+
+void ParallelSearch::stop() {
+  std::lock_guard<std::mutex> lock(_stop_mutex);
+  _stops++;
+  _stop_flag = true;
+}
+
+uint32_t ParallelSearch::stopToken() {
+  std::lock_guard<std::mutex> lock(_stop_mutex);
+  return _stops;
+}
+
+// Runs a helper search on its own board until the stop flag is set
+static void run_helper(Search *search, Board board, SearchLimits limits, const KeyHistory *history, long *nodes) {
+  SearchResult result = search->run(board, limits, history);
+  *nodes = result.nodes;
+}
+
+SearchResult ParallelSearch::run(Board &board, const SearchLimits &limits, const KeyHistory *history) {
+  return run(board, limits, history, stopToken());
+}
+
+SearchResult ParallelSearch::run(Board &board, const SearchLimits &limits, const KeyHistory *history,
+                                 uint32_t token) {
+  {
+    // The flag is left set by the last search, which used it to stop its helpers
+    std::lock_guard<std::mutex> lock(_stop_mutex);
+    _stop_flag = _stops != token;
+  }
+  _tt->newSearch();
+
+  // Helpers are only bounded by the main search, which stops them when it finishes
+  SearchLimits helper_limits;
+  helper_limits.depth = limits.depth;
+  std::vector<std::unique_ptr<Search> > helpers;
+  std::vector<std::thread> threads;
+  std::vector<long> helper_nodes(_threads, 0);
+  for (int i = 1; i < _threads; i++) {
+    helpers.push_back(std::unique_ptr<Search>(new Search(*_tt, &_stop_flag)));
+    helpers.back()->setThreadIndex(i);
+    threads.push_back(std::thread(run_helper, helpers.back().get(), board,
+                                  helper_limits, history, &helper_nodes[i]));
+  }
+
+  // The search holds large tables, so keep it off the stack
+  std::unique_ptr<Search> main_search(new Search(*_tt, &_stop_flag));
+  main_search->setThreadIndex(0);
+  main_search->setInfoCallback(_info_callback);
+  SearchResult result = main_search->run(board, limits, history);
+
+  _stop_flag = true;
+  for (uint32_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+    result.nodes += helper_nodes[i + 1];
+  }
+  return result;
+}
+
+// Returns the score of board searched to depth, from the side to move's
+//  point of view. Scores outside (alpha, beta) are only bounds.
+int Search::_negamax(Board &board, int depth, int alpha, int beta, int ply) {
+  if (depth <= 0) {
+    return _quiescence(board, alpha, beta, ply);
+  }
+  _pv_length[ply] = ply;
+  _nodes++;
+  if ((_nodes & 1023) == 0 && _should_stop()) {
+    _stopped = true;
+  }
+  if (_stopped) {
+    return 0;
+  }
+  if (ply >= MAX_PLY - 1) {
+    return Evaluator::evaluate(board);
+  }
+  // One repetition is enough to score a draw: if repeating once was best,
+  //  it will be again. The root is searched anyway, so there is a move to play
+  if (ply > 0 && board.isDraw(_keys, 1)) {
+    return 0;
+  }
+
+  // A deep enough result for this position may already be known. The root
+  //  is always searched, so that there is a best move and PV to report
+  TTData tt;
+  uint16_t tt_move = NO_TT_MOVE;
+  if (_tt->probe(board.hash(), tt)) {
+    tt_move = tt.move;
+    if (ply > 0 && tt.depth >= depth) {
+      int score = score_from_tt(tt.score, ply);
+      if (tt.bound == BOUND_EXACT
+          || (tt.bound == BOUND_LOWER && score >= beta)
+          || (tt.bound == BOUND_UPPER && score <= alpha)) {
+        return score;
+      }
+    }
+  }
+
+  // Moves come from the picker in stages, most promising first
+  MovePicker picker(board, tt_move, _killers[ply], _history);
+  int alpha_orig = alpha;
+  int best_score = -INFINITE_SCORE;
+  Move best_move = NO_MOVE;
+  Move move;
+  while (picker.next(move)) {
+    Undo undo;
+    bool quiet = !board.isCaptureOrPromotion(move);
+    board.doMove(move, undo);
+    _keys.push(board.hash());
+    int score = -_negamax(board, depth - 1, -beta, -alpha, ply + 1);
+    _keys.pop();
+    board.undoMove(move, undo);
+    if (_stopped) {
+      return 0;
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      best_move = move;
+      if (score > alpha) {
+        alpha = score;
+        // This move followed by the child's PV is the new best line
+        _pv[ply][ply] = move;
+        for (int j = ply + 1; j < _pv_length[ply + 1]; j++) {
+          _pv[ply][j] = _pv[ply + 1][j];
+        }
+        _pv_length[ply] = _pv_length[ply + 1];
+        if (alpha >= beta) {
+          // The opponent will avoid this position. A quiet move that refutes
+          //  it is likely to refute its siblings too
+          if (quiet) {
+            if (!(_killers[ply][0] == move)) {
+              _killers[ply][1] = _killers[ply][0];
+              _killers[ply][0] = move;
+            }
+            int &history = _history[board.colorToPlay()][SQ64(move.src)][SQ64(move.dest)];
+            history += depth * depth;
+            if (history > HISTORY_MAX) {
+              // Halve every score, keeping the order while making room for new cutoffs
+              for (int c = 0; c < 2; c++) {
+                for (int from = 0; from < 64; from++) {
+                  for (int to = 0; to < 64; to++) {
+                    _history[c][from][to] /= 2;
+                  }
+                }
+              }
+            }
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  if (best_move == NO_MOVE) {
+    // Checkmate, preferring the quickest mate, or stalemate
+    return board.inCheck() ? -MATE_SCORE + ply : 0;
+  }
+
+  int bound = best_score >= beta ? BOUND_LOWER
+    : best_score > alpha_orig ? BOUND_EXACT : BOUND_UPPER;
+  _tt->store(board.hash(), depth, bound, score_to_tt(best_score, ply),
+             bound == BOUND_UPPER ? NO_TT_MOVE : encode_move(best_move));
+  return best_score;
+}
+
+// Only captures that do not lose material are searched, and the side to move
+//  may "stand pat" on the evaluation instead, since it is never forced to
+//  capture. In check every evasion is searched, as standing pat is not an option.
+int Search::_quiescence(Board &board, int alpha, int beta, int ply) {
+  _pv_length[ply] = ply;
+  _nodes++;
+  if ((_nodes & 1023) == 0 && _should_stop()) {
+    _stopped = true;
+  }
+  if (_stopped) {
+    return 0;
+  }
+  if (ply >= MAX_PLY - 1) {
+    return Evaluator::evaluate(board);
+  }
+
+  TTData tt;
+  uint16_t tt_move = NO_TT_MOVE;
+  if (_tt->probe(board.hash(), tt)) {
+    tt_move = tt.move;
+    int score = score_from_tt(tt.score, ply);
+    if (tt.bound == BOUND_EXACT
+        || (tt.bound == BOUND_LOWER && score >= beta)
+        || (tt.bound == BOUND_UPPER && score <= alpha)) {
+      return score;
+    }
+  }
+
+  bool in_check = board.inCheck();
+  int alpha_orig = alpha;
+  int best_score = -INFINITE_SCORE;
+  if (!in_check) {
+    best_score = Evaluator::evaluate(board);
+    if (best_score >= beta) {
+      return best_score;
+    }
+    if (best_score > alpha) {
+      alpha = best_score;
+    }
+  }
+
+  MovePicker picker(board, tt_move, _killers[ply], _history, !in_check);
+  Move best_move = NO_MOVE;
+  Move move;
+  while (picker.next(move)) {
+    Undo undo;
+    board.doMove(move, undo);
+    int score = -_quiescence(board, -beta, -alpha, ply + 1);
+    board.undoMove(move, undo);
+    if (_stopped) {
+      return 0;
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      best_move = move;
+      if (score > alpha) {
+        alpha = score;
+        if (alpha >= beta) {
+          break;
+        }
+      }
+    }
+  }
+
+  if (in_check && best_move == NO_MOVE) {
+    return -MATE_SCORE + ply;
+  }
+
+  int bound = best_score >= beta ? BOUND_LOWER
+    : best_score > alpha_orig ? BOUND_EXACT : BOUND_UPPER;
+  _tt->store(board.hash(), 0, bound, score_to_tt(best_score, ply),
+             bound == BOUND_UPPER || best_move == NO_MOVE ? NO_TT_MOVE : encode_move(best_move));
+  return best_score;
+}
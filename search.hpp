@@ -0,0 +1,126 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _SEARCH_HPP_
+#define _SEARCH_HPP_
+
+// search.hpp
+// Chooses a move for the side to move: a negamax alpha-beta search, run with
+// iterative deepening until one of the limits is reached.
+
+#include "board.hpp"
+#include "tt.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#define MAX_PLY 128
+#define INFINITE_SCORE 32000
+#define MATE_SCORE 31000  // Score for giving mate now. Mate in n plies scores MATE_SCORE - n
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)  // Any score beyond this is a forced mate
+#define HISTORY_MAX (1 << 20)  // History scores are halved when one grows past this
+
+// Limits for a search. Zero means no limit, and the search stops at the first limit it reaches
+struct SearchLimits {
+  int depth;
+  long nodes;
+  long movetime_ms;
+
+  SearchLimits() : depth(0), nodes(0), movetime_ms(0) {}
+};
+
+struct SearchResult {
+  Move best_move;  // NO_MOVE if there are no legal moves
+  int score;  // Centipawns from the side to move's point of view
+  int depth;  // Deepest iteration that finished
+  long nodes;
+  std::vector<Move> pv;  // Principal variation, starting with best_move
+};
+
+class Search {
+  public:
+    // Results are remembered in tt, which may outlive the search. Searches
+    //  that should all stop together can share a stop_flag, which is then
+    //  reset by its owner rather than by run()
+    Search(TranspositionTable &tt, std::atomic<bool> *stop_flag = NULL);
+
+    // Searches board (which is left unchanged) and returns the result of
+    //  the deepest iteration to finish. The first iteration always finishes,
+    //  so there is a move to play even with very tight limits. history holds
+    //  the game that led to board, if repetitions of it should count.
+    SearchResult run(Board &board, const SearchLimits &limits, const KeyHistory *history = NULL);
+
+    // Asks a running search to stop as soon as possible. Safe to call from another thread
+    void stop() { *_stop_flag = true; }
+
+    // Makes this search a helper thread of a ParallelSearch. Helpers
+    //  with odd indexes search one ply deeper each iteration, so the threads
+    //  are spread over different depths
+    void setThreadIndex(int index) { _thread_index = index; }
+
+    // Called with the result so far each time an iteration finishes, e.g. to print UCI info
+    void setInfoCallback(std::function<void(const SearchResult &)> callback) { _info_callback = callback; }
+
+  private:
+    TranspositionTable *_tt;
+    std::function<void(const SearchResult &)> _info_callback;
+    std::atomic<bool> _own_stop_flag;
+    std::atomic<bool> *_stop_flag;
+    int _thread_index;  // 0 for the main search
+    bool _stopped;  // Set when the current iteration was cut short, so its result is discarded
+    SearchLimits _limits;
+    std::chrono::steady_clock::time_point _start;
+    long _nodes;
+    int _root_depth;
+    KeyHistory _keys;  // The game before the root, then the moves being searched
+
+    // Triangular principal variation table. _pv[ply] holds the best line found from ply
+    Move _pv[MAX_PLY][MAX_PLY];
+    int _pv_length[MAX_PLY];
+
+    // Move ordering heuristics for quiet moves: the last two that caused a
+    //  cutoff at each ply, and a score per [color][source][destination]
+    //  raised every time that move causes a cutoff anywhere
+    Move _killers[MAX_PLY][2];
+    int _history[2][64][64];
+
+    int _negamax(Board &board, int depth, int alpha, int beta, int ply);
+    // Searches captures only until the position is quiet, so the evaluation
+    //  is never taken in the middle of an exchange
+    int _quiescence(Board &board, int alpha, int beta, int ply);
+    // Whether a limit has been hit, checked every so many nodes
+    bool _should_stop();
+};
+
+// Lazy SMP search: every thread searches the same root on its own copy of the
+// board, sharing one transposition table. The threads mostly help each other
+// through the table, where each one finds results the others can reuse.
+class ParallelSearch {
+  public:
+    ParallelSearch(TranspositionTable &tt, int threads = 1);
+
+    void setThreads(int threads) { _threads = threads < 1 ? 1 : threads; }
+    // Passed on to the main search. Its node counts are the main thread's only
+    void setInfoCallback(std::function<void(const SearchResult &)> callback) { _info_callback = callback; }
+
+    // Runs on the calling thread plus threads - 1 helpers, and returns the
+    //  main search's result with the node count of every thread
+    SearchResult run(Board &board, const SearchLimits &limits, const KeyHistory *history = NULL);
+    // As above, for a search started on another thread: every stop() since
+    //  token was taken with stopToken() stops it, even one sent before it starts
+    SearchResult run(Board &board, const SearchLimits &limits, const KeyHistory *history, uint32_t token);
+
+    // Stops every thread of the running search. Safe to call from another thread
+    void stop();
+    uint32_t stopToken();
+
+  private:
+    TranspositionTable *_tt;
+    int _threads;
+    std::atomic<bool> _stop_flag;  // Read by the searches, and set for the search run() is in
+    std::mutex _stop_mutex;  // Guards _stops, so run() cannot clear a stop it should see
+    uint32_t _stops;  // Calls to stop() so far
+    std::function<void(const SearchResult &)> _info_callback;
+};
+
+#endif // _SEARCH_HPP_
@@ -5,6 +5,8 @@
 */
 #define _GLIBCXX_USE_CXX11_ABI 0
 #include "board.hpp"
+#include "perft_table.hpp"
+#include "thread_pool.hpp"
 #include <iostream>
 #include <string>
 #include <cstdlib>
@@ -13,10 +15,39 @@
 #include <stdexcept>
 #include <array>
 
-int main() {
+int main(int argc, char **argv) {
+  // --hash <MB> caches subtree counts in a perft table of that size
+  // --threads <N> splits the perft across N threads
+  size_t hash_mb = 0;
+  int threads = 1;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--hash" && i + 1 < argc) {
+      hash_mb = std::strtoul(argv[++i], NULL, 10);
+    } else if (std::string(argv[i]) == "--threads" && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+    }
+  }
+
   // Create a board of our own
   Board b("r3k2r/p2n1pp1/2pb1p1p/qp1p3P/3P1PP1/2NQP1N1/PPP5/R3K2R w KQkq - 2 15");
-  int count = b.perft(3, true);
+  std::unique_ptr<PerftTable> table;
+  if (hash_mb > 0) {
+    table.reset(new PerftTable(hash_mb));
+  }
+  long count;
+  if (threads > 1) {
+    ThreadPool pool(threads);
+    std::vector<long> subcounts;
+    MoveList moves = b.generateMoves();
+    count = b.perftParallel(3, pool, table.get(), &subcounts);
+    for (uint32_t i = 0; i < moves.size(); i++) {
+      std::cout << sq_name(moves[i].src) << sq_name(moves[i].dest) << ": " << subcounts[i] << std::endl;
+    }
+  } else if (table) {
+    count = b.perft(3, *table);
+  } else {
+    count = b.perft(3, true);
+  }
   std::cout << "Nodes searched: " << count << std::endl;
   return 0;
 }
@@ -0,0 +1,111 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// thread_pool.cc
+// Work-stealing thread pool
+
+#include "thread_pool.hpp"
+
+// The pool whose worker is running on this thread, if any, and that worker's
+//  index. A worker may submit to other pools, where its index means nothing
+static thread_local const ThreadPool *worker_pool = NULL;
+static thread_local int worker_index = -1;
+
+ThreadPool::ThreadPool(int num_threads)
+  : _queued(0), _pending(0), _next_queue(0), _stopping(false) {
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  for (int i = 0; i < num_threads; i++) {
+    _queues.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+  for (int i = 0; i < num_threads; i++) {
+    _threads.push_back(std::thread(&ThreadPool::_worker_loop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _work_available.notify_all();
+  for (size_t i = 0; i < _threads.size(); i++) {
+    _threads[i].join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  int index = worker_pool == this ? worker_index : -1;
+  {
+    // Counted before it is queued, since once queued another worker may run
+    //  it to completion, and a task submitting this one must still be pending
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queued++;
+    _pending++;
+    if (index < 0) {
+      index = _next_queue;
+      _next_queue = (_next_queue + 1) % _queues.size();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+    _queues[index]->tasks.push_back(std::move(task));
+  }
+  _work_available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _all_done.wait(lock, [this] { return _pending == 0; });
+}
+
+bool ThreadPool::_take_task(int index, std::function<void()> &task) {
+  // Own queue first, newest task first as its data is most likely still in cache
+  {
+    Queue &own = *_queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  // Steal the oldest task from another worker, which is usually the biggest
+  for (size_t i = 1; i < _queues.size(); i++) {
+    Queue &other = *_queues[(index + i) % _queues.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::_worker_loop(int index) {
+  worker_pool = this;
+  worker_index = index;
+  while (true) {
+    std::function<void()> task;
+    if (_take_task(index, task)) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queued--;
+      }
+      task();
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_pending == 0) {
+        _all_done.notify_all();
+      }
+      continue;
+    }
+
+    // Nothing to take, so sleep until something is submitted
+    std::unique_lock<std::mutex> lock(_mutex);
+    _work_available.wait(lock, [this] { return _stopping || _queued > 0; });
+    if (_stopping && _queued == 0) {
+      return;
+    }
+  }
+}
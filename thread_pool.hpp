@@ -0,0 +1,57 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+// thread_pool.hpp
+// A fixed set of worker threads running submitted tasks. Each worker has its
+// own queue and takes the newest task from it, and when that runs dry it
+// steals the oldest task from another worker, so the work spreads out evenly
+// even when tasks are of very different sizes.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+  public:
+    // Starts num_threads workers (at least one)
+    ThreadPool(int num_threads);
+    // Finishes the queued tasks, then joins the workers
+    ~ThreadPool();
+
+    // Queues a task. Tasks submitted from a worker go on that worker's own queue
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has finished running. Must not be
+    //  called from inside a task
+    void wait();
+
+    int size() const { return (int)_threads.size(); }
+
+  private:
+    struct Queue {
+      std::mutex mutex;
+      std::deque<std::function<void()> > tasks;
+    };
+
+    std::vector<std::thread> _threads;
+    std::vector<std::unique_ptr<Queue> > _queues;
+
+    // Guards the counts below, which the workers sleep and wake on
+    std::mutex _mutex;
+    std::condition_variable _work_available;
+    std::condition_variable _all_done;
+    int _queued;  // Tasks waiting in a queue
+    int _pending;  // Tasks submitted but not yet finished
+    int _next_queue;  // Round-robin queue for tasks submitted from outside the pool
+    bool _stopping;
+
+    void _worker_loop(int index);
+    // Takes a task from queue index, or failing that steals one from another queue
+    bool _take_task(int index, std::function<void()> &task);
+};
+
+#endif // _THREAD_POOL_HPP_
@@ -0,0 +1,117 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// tt.cc
+// Lockless bucketed transposition table with aging
+
+#include "tt.hpp"
+
+// Layout of an entry's data word
+#define MOVE_SHIFT 0
+#define SCORE_SHIFT 16
+#define DEPTH_SHIFT 32
+#define BOUND_SHIFT 40
+#define GENERATION_SHIFT 42
+
+TranspositionTable::TranspositionTable(size_t size_mb) : _mask(0), _generation(0) {
+  resize(size_mb);
+}
+
+void TranspositionTable::resize(size_t size_mb) {
+  size_t num_buckets = 1;
+  while (num_buckets * 2 * sizeof(Bucket) <= size_mb * 1024 * 1024) {
+    num_buckets *= 2;
+  }
+  _buckets.reset(new Bucket[num_buckets]);
+  _mask = num_buckets - 1;
+  clear();
+}
+
+void TranspositionTable::clear() {
+  for (size_t i = 0; i <= _mask; i++) {
+    for (int j = 0; j < TT_BUCKET_SIZE; j++) {
+      _buckets[i].entries[j].key.store(0, std::memory_order_relaxed);
+      _buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+    }
+  }
+  _generation = 0;
+}
+
+uint64_t TranspositionTable::_pack(int depth, int bound, int score, uint16_t move, int generation) {
+  return ((uint64_t)move << MOVE_SHIFT)
+    | ((uint64_t)(uint16_t)(int16_t)score << SCORE_SHIFT)
+    | ((uint64_t)(uint8_t)depth << DEPTH_SHIFT)
+    | ((uint64_t)bound << BOUND_SHIFT)
+    | ((uint64_t)generation << GENERATION_SHIFT);
+}
+
+bool TranspositionTable::probe(uint64_t hash, TTData &out) const {
+  const Bucket &bucket = _buckets[hash & _mask];
+  for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+    uint64_t key = bucket.entries[i].key.load(std::memory_order_relaxed);
+    uint64_t data = bucket.entries[i].data.load(std::memory_order_relaxed);
+    int bound = (int)((data >> BOUND_SHIFT) & 3);
+    if ((key ^ data) == hash && bound != BOUND_NONE) {
+      out.move = (uint16_t)(data >> MOVE_SHIFT);
+      out.score = (int16_t)(data >> SCORE_SHIFT);
+      out.depth = (int8_t)(data >> DEPTH_SHIFT);
+      out.bound = bound;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::store(uint64_t hash, int depth, int bound, int score, uint16_t move) {
+  Bucket &bucket = _buckets[hash & _mask];
+
+  // Overwrite this position's own entry if it has one. Otherwise replace the
+  //  entry worth least: shallow entries left over from old searches go first
+  int replace = 0;
+  int replace_worth = 0x7FFFFFFF;
+  for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+    uint64_t key = bucket.entries[i].key.load(std::memory_order_relaxed);
+    uint64_t data = bucket.entries[i].data.load(std::memory_order_relaxed);
+    if ((key ^ data) == hash) {
+      // A much shallower bound, e.g. from the quiescence search, is not worth
+      //  losing a deep result from this search for
+      int old_depth = (int8_t)(data >> DEPTH_SHIFT);
+      int old_generation = (int)((data >> GENERATION_SHIFT) & GENERATION_MASK);
+      if (bound != BOUND_EXACT && depth < old_depth - 2 && old_generation == _generation) {
+        return;
+      }
+      // Keep the old best move rather than forget it
+      if (move == NO_TT_MOVE) {
+        move = (uint16_t)(data >> MOVE_SHIFT);
+      }
+      replace = i;
+      break;
+    }
+    int entry_depth = (int8_t)(data >> DEPTH_SHIFT);
+    int entry_generation = (int)((data >> GENERATION_SHIFT) & GENERATION_MASK);
+    int age = (_generation - entry_generation) & GENERATION_MASK;
+    int worth = ((data >> BOUND_SHIFT) & 3) == BOUND_NONE ? -0x10000 : entry_depth - 8 * age;
+    if (worth < replace_worth) {
+      replace = i;
+      replace_worth = worth;
+    }
+  }
+
+  uint64_t data = _pack(depth, bound, score, move, _generation);
+  bucket.entries[replace].key.store(hash ^ data, std::memory_order_relaxed);
+  bucket.entries[replace].data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const {
+  int used = 0;
+  int sampled = 0;
+  for (size_t i = 0; i <= _mask && sampled < 1000; i++) {
+    for (int j = 0; j < TT_BUCKET_SIZE && sampled < 1000; j++) {
+      uint64_t data = _buckets[i].entries[j].data.load(std::memory_order_relaxed);
+      int generation = (int)((data >> GENERATION_SHIFT) & GENERATION_MASK);
+      if (((data >> BOUND_SHIFT) & 3) != BOUND_NONE && generation == _generation) {
+        used++;
+      }
+      sampled++;
+    }
+  }
+  return sampled == 0 ? 0 : used * 1000 / sampled;
+}
@@ -0,0 +1,88 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _TT_HPP_
+#define _TT_HPP_
+
+// tt.hpp
+// Transposition table for the search. Remembers the score, depth and best move
+// found for each position, so a position reached again through another move
+// order can reuse the result, or at least try the best move first.
+
+#include "board.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+#define TT_BUCKET_SIZE 4  // Entries per bucket, so a bucket fills one 64-byte cache line
+
+// How the stored score relates to the true score of the position
+#define BOUND_NONE 0
+#define BOUND_UPPER 1  // Every move failed low, the true score is at most this
+#define BOUND_LOWER 2  // A move failed high, the true score is at least this
+#define BOUND_EXACT 3
+
+#define NO_TT_MOVE 0
+
+// What the table remembers about a position
+struct TTData {
+  uint16_t move;  // From encode_move, or NO_TT_MOVE
+  int score;
+  int depth;
+  int bound;
+};
+
+// Packs a move into 16 bits: 6 bits each for the bitboard source and destination
+//  squares, and the promotion piece type (without color) in the top bits
+inline uint16_t encode_move(const Move &move) {
+  int promotion = move.promotion == NO_PROMOTION ? 0 : (move.promotion > 0 ? move.promotion : -move.promotion);
+  return (uint16_t)(SQ64(move.src) | (SQ64(move.dest) << 6) | (promotion << 12));
+}
+
+// Unpacks a move from encode_move for the side color. The result may not be
+//  legal in the position it is used in, so check it with Board::isLegal first
+inline Move decode_move(uint16_t packed, int color) {
+  int promotion = packed >> 12;
+  Move move = {SQ256(packed & 0x3F), SQ256((packed >> 6) & 0x3F),
+               promotion == 0 ? NO_PROMOTION : (color == WHITE ? promotion : -promotion)};
+  return move;
+}
+
+class TranspositionTable {
+  public:
+    // Allocates about size_mb megabytes (rounded down to a power of two buckets)
+    TranspositionTable(size_t size_mb);
+
+    // Reallocates the table at a new size, which also clears it
+    void resize(size_t size_mb);
+    void clear();
+    // Starts a new search. Entries from earlier searches are replaced first
+    void newSearch() { _generation = (_generation + 1) & GENERATION_MASK; }
+
+    bool probe(uint64_t hash, TTData &data) const;
+    void store(uint64_t hash, int depth, int bound, int score, uint16_t move);
+
+    // Approximate fill rate in permille, sampled from the first buckets
+    int hashfull() const;
+
+  private:
+    static const int GENERATION_MASK = 0x3F;
+
+    // Entries are read and written without locks, so search threads can share
+    //  the table. As in PerftTable, the key is stored XORed with the data so
+    //  an entry torn by two threads writing at once fails the key check.
+    struct Entry {
+      std::atomic<uint64_t> key;  // Position hash XOR data
+      std::atomic<uint64_t> data;  // Packed by _pack
+    };
+    struct Bucket {
+      Entry entries[TT_BUCKET_SIZE];
+    };
+
+    std::unique_ptr<Bucket[]> _buckets;
+    size_t _mask;  // Number of buckets - 1
+    int _generation;
+
+    static uint64_t _pack(int depth, int bound, int score, uint16_t move, int generation);
+};
+
+#endif // _TT_HPP_
@@ -0,0 +1,295 @@
+/*  uci_client.cc
+ *  Description: Speaks the UCI protocol on stdin/stdout, so the engine can
+ *               be used from a chess GUI. The search runs on its own thread
+ *               while this one keeps reading commands, so "stop", "isready"
+ *               and "quit" are answered while the engine is thinking.
+*/
+#define _GLIBCXX_USE_CXX11_ABI 0
+#include "board.hpp"
+#include "book.hpp"
+#include "search.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#define ENGINE_NAME "Chess"
+#define DEFAULT_HASH_MB 16
+#define MAX_HASH_MB 4096
+#define MAX_THREADS 256
+#define DEFAULT_MOVES_TO_GO 30  // Moves the remaining time is shared between when the GUI doesn't say
+#define MOVE_OVERHEAD_MS 30  // Kept back from every move for GUI and pipe latency
+
+// Both threads print, so whole lines are written under a lock
+static std::mutex output_mutex;
+
+static void send(const std::string &line) {
+  std::lock_guard<std::mutex> lock(output_mutex);
+  std::cout << line << std::endl;
+}
+
+static std::string uci_score(int score) {
+  if (score >= MATE_BOUND) {
+    return "mate " + std::to_string((MATE_SCORE - score + 1) / 2);
+  } else if (score <= -MATE_BOUND) {
+    return "mate -" + std::to_string((MATE_SCORE + score) / 2);
+  }
+  return "cp " + std::to_string(score);
+}
+
+class UciEngine {
+  public:
+    UciEngine() : _tt(DEFAULT_HASH_MB), _search(_tt), _own_book(true), _random(std::random_device()()),
+                  _searching(false), _infinite(false) {
+      _search.setInfoCallback([this](const SearchResult &result) { _info(result); });
+    }
+    ~UciEngine() { _stop_search(); }
+
+    // Handles one line of input, returning false on "quit"
+    bool command(const std::string &line);
+
+  private:
+    Board _board;
+    KeyHistory _history;  // The game up to _board, so the search sees its repetitions
+    TranspositionTable _tt;
+    ParallelSearch _search;
+    PolyglotBook _book;
+    bool _own_book;  // Whether to play from _book while it has moves
+    std::mt19937_64 _random;  // Chooses between book moves
+    std::thread _thread;
+    bool _searching;  // Whether _thread has been started and not yet joined
+    std::chrono::steady_clock::time_point _start;
+
+    // "go infinite" must not print bestmove until told to stop, even when the search ends by itself
+    std::mutex _stop_mutex;
+    std::condition_variable _stop_condition;
+    bool _infinite;
+
+    void _position(std::istringstream &args);
+    void _go(std::istringstream &args);
+    void _setoption(std::istringstream &args);
+    // Stops a running search and waits for its bestmove to be printed
+    void _stop_search();
+    void _run_search(Board board, KeyHistory history, SearchLimits limits, uint32_t stop_token);
+    void _info(const SearchResult &result);
+};
+
+bool UciEngine::command(const std::string &line) {
+  std::istringstream args(line);
+  std::string token;
+  args >> token;
+  if (token == "uci") {
+    send("id name " ENGINE_NAME);
+    send("id author " ENGINE_NAME " authors");
+    send("option name Hash type spin default " + std::to_string(DEFAULT_HASH_MB)
+         + " min 1 max " + std::to_string(MAX_HASH_MB));
+    send("option name Threads type spin default 1 min 1 max " + std::to_string(MAX_THREADS));
+    send("option name OwnBook type check default true");
+    send("option name BookFile type string default <empty>");
+    send("uciok");
+  } else if (token == "isready") {
+    send("readyok");
+  } else if (token == "ucinewgame") {
+    _stop_search();
+    _tt.clear();
+  } else if (token == "setoption") {
+    _stop_search();
+    _setoption(args);
+  } else if (token == "position") {
+    _stop_search();
+    _position(args);
+  } else if (token == "go") {
+    _stop_search();
+    _go(args);
+  } else if (token == "stop") {
+    _stop_search();
+  } else if (token == "quit") {
+    _stop_search();
+    return false;
+  } else if (token == "d") {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout << _board << std::endl << _board.to_fen() << std::endl;
+  } else if (!token.empty()) {
+    send("info string Unknown command: " + token);
+  }
+  return true;
+}
+
+// position [startpos | fen <fen>] [moves <move>...]
+void UciEngine::_position(std::istringstream &args) {
+  std::string token;
+  args >> token;
+  if (token == "startpos") {
+    _board.setFen(INITIAL_FEN);
+    args >> token;
+  } else if (token == "fen") {
+    std::string fen;
+    while (args >> token && token != "moves") {
+      fen += (fen.empty() ? "" : " ") + token;
+    }
+    if (_board.setFen(fen) != FEN_OK) {
+      send("info string Bad FEN: " + fen);
+      _board.setFen(INITIAL_FEN);
+      _history.reset(_board);
+      return;
+    }
+  } else {
+    send("info string Expected startpos or fen");
+    return;
+  }
+  _history.reset(_board);
+
+  if (token != "moves") {
+    return;
+  }
+  // The GUI resends the whole game every move, and its moves are legal,
+  //  so they are only decoded rather than checked
+  std::string moves;
+  std::getline(args, moves);
+  int played = 0;
+  if (!_board.replayUci(moves, REPLAY_TRUSTED, &played, &_history)) {
+    send("info string Bad move " + std::to_string(played + 1) + " in:" + moves);
+  }
+}
+
+// go [depth D] [nodes N] [movetime MS] [wtime MS] [btime MS] [winc MS] [binc MS] [movestogo N] [infinite]
+void UciEngine::_go(std::istringstream &args) {
+  SearchLimits limits;
+  long time[2] = {0, 0};
+  long increment[2] = {0, 0};
+  long moves_to_go = 0;
+  bool infinite = false;
+  std::string token;
+  while (args >> token) {
+    if (token == "depth") {
+      args >> limits.depth;
+    } else if (token == "nodes") {
+      args >> limits.nodes;
+    } else if (token == "movetime") {
+      args >> limits.movetime_ms;
+    } else if (token == "wtime") {
+      args >> time[WHITE];
+    } else if (token == "btime") {
+      args >> time[BLACK];
+    } else if (token == "winc") {
+      args >> increment[WHITE];
+    } else if (token == "binc") {
+      args >> increment[BLACK];
+    } else if (token == "movestogo") {
+      args >> moves_to_go;
+    } else if (token == "infinite") {
+      infinite = true;
+    }
+  }
+
+  // With a clock, spend an even share of the time left plus most of the
+  //  increment, never more than half of what is left
+  int color = _board.colorToPlay();
+  if (!infinite && limits.movetime_ms == 0 && time[color] > 0) {
+    long left = std::max(1L, time[color] - MOVE_OVERHEAD_MS);
+    long budget = left / (moves_to_go > 0 ? moves_to_go : DEFAULT_MOVES_TO_GO) + increment[color] * 3 / 4;
+    limits.movetime_ms = std::max(1L, std::min(budget, left / 2));
+  }
+
+  // A book move is played at once. Analysis is always searched
+  Move book_move;
+  if (_own_book && !infinite && _book.probe(_board, _random(), book_move)) {
+    send("bestmove " + move_to_uci(book_move));
+    return;
+  }
+
+  _infinite = infinite;
+  _start = std::chrono::steady_clock::now();
+  // Taken here rather than on the search thread, so a stop that comes in
+  //  before that thread gets going is not lost
+  uint32_t stop_token = _search.stopToken();
+  _searching = true;
+  _thread = std::thread(&UciEngine::_run_search, this, _board, _history, limits, stop_token);
+}
+
+// setoption name <name> value <value>
+void UciEngine::_setoption(std::istringstream &args) {
+  std::string token, name, value;
+  args >> token;
+  while (args >> token && token != "value") {
+    name += (name.empty() ? "" : " ") + token;
+  }
+  // The value may be a path with spaces in it
+  std::getline(args, value);
+  value.erase(0, value.find_first_not_of(' '));
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  if (name == "hash") {
+    long mb = std::atol(value.c_str());
+    _tt.resize(std::max(1L, std::min(mb, (long)MAX_HASH_MB)));
+  } else if (name == "threads") {
+    int threads = std::atoi(value.c_str());
+    _search.setThreads(std::max(1, std::min(threads, MAX_THREADS)));
+  } else if (name == "ownbook") {
+    _own_book = value == "true";
+  } else if (name == "bookfile") {
+    if (value.empty() || value == "<empty>") {
+      _book.close();
+      return;
+    }
+    BookError error = _book.open(value.c_str());
+    if (error == BOOK_BAD_KEYS) {
+      send("info string Polyglot keys do not match the published ones, so books cannot be used");
+    } else if (error != BOOK_OK) {
+      send("info string Cannot read book " + value);
+    }
+  } else {
+    send("info string Unknown option: " + name);
+  }
+}
+
+void UciEngine::_stop_search() {
+  if (!_searching) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_stop_mutex);
+    _infinite = false;
+  }
+  _stop_condition.notify_all();
+  _search.stop();
+  _thread.join();
+  _searching = false;
+}
+
+void UciEngine::_run_search(Board board, KeyHistory history, SearchLimits limits, uint32_t stop_token) {
+  SearchResult result = _search.run(board, limits, &history, stop_token);
+
+  std::unique_lock<std::mutex> lock(_stop_mutex);
+  _stop_condition.wait(lock, [this]() { return !_infinite; });
+  send("bestmove " + move_to_uci(result.best_move));
+}
+
+void UciEngine::_info(const SearchResult &result) {
+  long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - _start).count();
+  std::string line = "info depth " + std::to_string(result.depth) + " score " + uci_score(result.score)
+    + " nodes " + std::to_string(result.nodes) + " nps " + std::to_string(result.nodes * 1000 / std::max(1L, elapsed))
+    + " time " + std::to_string(elapsed) + " hashfull " + std::to_string(_tt.hashfull()) + " pv";
+  for (uint32_t i = 0; i < result.pv.size(); i++) {
+    line += " " + move_to_uci(result.pv[i]);
+  }
+  send(line);
+}
+
+int main() {
+  UciEngine engine;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (!engine.command(line)) {
+      break;
+    }
+  }
+  return 0;
+}
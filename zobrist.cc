@@ -0,0 +1,51 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+// zobrist.cc
+// Generates the Zobrist keys from a fixed seed, so hashes are the same on every run
+
+#include "zobrist.hpp"
+
+uint64_t ZOBRIST_PIECES[2][7][64];
+uint64_t ZOBRIST_CASTLING[16];
+uint64_t ZOBRIST_EN_PASSANT[8];
+uint64_t ZOBRIST_BLACK_TO_PLAY;
+
+// xorshift64* generator
+static uint64_t next_key(uint64_t &state) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+static void fill_keys() {
+  uint64_t state = 1070372;
+  for (int color = 0; color < 2; color++) {
+    for (int piece = 0; piece < 7; piece++) {
+      for (int sq = 0; sq < 64; sq++) {
+        ZOBRIST_PIECES[color][piece][sq] = next_key(state);
+      }
+    }
+  }
+  // Each castling right gets a key, and a set of rights is the XOR of its keys
+  uint64_t rights[4];
+  for (int i = 0; i < 4; i++) {
+    rights[i] = next_key(state);
+  }
+  for (int mask = 0; mask < 16; mask++) {
+    ZOBRIST_CASTLING[mask] = 0;
+    for (int i = 0; i < 4; i++) {
+      if (mask & (1 << i)) {
+        ZOBRIST_CASTLING[mask] ^= rights[i];
+      }
+    }
+  }
+  for (int file = 0; file < 8; file++) {
+    ZOBRIST_EN_PASSANT[file] = next_key(state);
+  }
+  ZOBRIST_BLACK_TO_PLAY = next_key(state);
+}
+
+void init_zobrist() {
+  static bool initialized = (fill_keys(), true);
+  (void)initialized;
+}
@@ -0,0 +1,20 @@
+#define _GLIBCXX_USE_CXX11_ABI 0
+#ifndef _ZOBRIST_HPP_
+#define _ZOBRIST_HPP_
+
+// zobrist.hpp
+// Random keys for hashing positions. A position's hash is the XOR of the keys
+// for each piece on its square, the castling rights, the en passant file and
+// the side to move, so a move only has to XOR in what it changed.
+
+#include <stdint.h>
+
+extern uint64_t ZOBRIST_PIECES[2][7][64];  // Indexed by color, piece type (PAWN..KING), bitboard square
+extern uint64_t ZOBRIST_CASTLING[16];  // Indexed by the castling rights bit-mask
+extern uint64_t ZOBRIST_EN_PASSANT[8];  // Indexed by file
+extern uint64_t ZOBRIST_BLACK_TO_PLAY;
+
+// Fills in the keys. Safe to call more than once.
+void init_zobrist();
+
+#endif // _ZOBRIST_HPP_